@@ -0,0 +1,463 @@
+/**
+ * Throughput benchmark of the simulation kernel.
+ *
+ * Usage: bench [key=value]...
+ *   modules=64   number of modules of the synthetic design
+ *   regs=16      registers per module
+ *   wires=16     wires per module
+ *   depth=4      length of each wire chain (fan-in depth)
+ *   width=32     bits of each register and wire (5, 16, 17 or 32)
+ *   cycles=20000 cycles to simulate
+ *   threads=1    CPU::set_threads
+ *   dirty=0      CPU::enable_dirty_sync
+ *   arena=0      CPU::enable_arena
+ *   topo=0       CPU::enable_topo_eval
+ *   trace=0      CPU::enable_trace to /dev/null: 1 VCD, 2 binary, 3 compressed
+ *   sweep=0      also run the synthetic design on 1, 2, 4, 8 and all hardware
+ *                threads, and report the speedup over 1 thread
+ *
+ * Besides the synthetic design, the designs of the alu and modules demos
+ * are simulated, driven by generated inputs instead of stdin.
+ * Build with optimization (e.g. -DCMAKE_BUILD_TYPE=Release).
+ */
+#include "tools.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using _Clock_t = std::chrono::steady_clock;
+
+double seconds_since(_Clock_t::time_point start) {
+	return std::chrono::duration<double>(_Clock_t::now() - start).count();
+}
+
+struct Options {
+	std::size_t modules     = 64;
+	std::size_t regs        = 16;
+	std::size_t wires       = 16;
+	std::size_t depth       = 4;
+	std::size_t width       = 32;
+	unsigned long long cycles = 20000;
+	std::size_t threads     = 1;
+	bool dirty = false;
+	bool arena = false;
+	bool topo  = false;
+	unsigned trace = 0;
+	bool sweep = false;
+
+	void configure(dark::CPU &cpu) const {
+		if (threads > 1) cpu.set_threads(threads);
+		if (dirty) cpu.enable_dirty_sync();
+		if (arena) cpu.enable_arena();
+		if (topo) cpu.enable_topo_eval();
+		if (trace != 0) cpu.enable_trace("/dev/null", static_cast<dark::TraceFormat>(trace - 1));
+	}
+};
+
+Options parse(int argc, char **argv) {
+	std::map<std::string, unsigned long long> values;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		auto pos = arg.find('=');
+		if (pos == std::string::npos) {
+			std::cerr << "Ignored argument: " << arg << '\n';
+			continue;
+		}
+		values[arg.substr(0, pos)] = std::strtoull(arg.c_str() + pos + 1, nullptr, 10);
+	}
+	auto get = [&](const char *key, auto fallback) {
+		auto iter = values.find(key);
+		return iter == values.end() ? fallback : static_cast<decltype(fallback)>(iter->second);
+	};
+
+	Options options;
+	options.modules = std::max<std::size_t>(get("modules", options.modules), 1);
+	options.regs    = std::max<std::size_t>(get("regs", options.regs), 1);
+	options.wires   = std::max<std::size_t>(get("wires", options.wires), 1);
+	options.depth   = std::max<std::size_t>(get("depth", options.depth), 1);
+	options.width   = get("width", options.width);
+	options.cycles  = get("cycles", options.cycles);
+	options.threads = get("threads", options.threads);
+	options.dirty   = get("dirty", 0ull) != 0;
+	options.arena   = get("arena", 0ull) != 0;
+	options.topo    = get("topo", 0ull) != 0;
+	options.trace   = static_cast<unsigned>(std::min(get("trace", 0ull), 3ull));
+	options.sweep   = get("sweep", 0ull) != 0;
+	return options;
+}
+
+/**
+ * A module sized at runtime. Wire j reads wire j - 1, so the wires form
+ * chains of `depth` wires. The head of each chain reads a register of
+ * the previous module. Each register accumulates one wire per cycle.
+ */
+template<std::size_t _Len>
+struct Synthetic : dark::ModuleBase {
+	std::size_t regs;
+	std::size_t wires;
+	std::unique_ptr<Register<_Len>[]> reg;
+	std::unique_ptr<Wire<_Len>[]> wire;
+
+	Synthetic(std::size_t regs, std::size_t wires)
+		: regs(regs), wires(wires),
+		  reg(std::make_unique<Register<_Len>[]>(regs)),
+		  wire(std::make_unique<Wire<_Len>[]>(wires)) {}
+
+	void connect(const Synthetic &prev, std::size_t depth) {
+		for (std::size_t j = 0; j < wires; ++j) {
+			if (j % depth == 0) {
+				auto *src = &prev.reg[j % prev.regs];
+				wire[j]   = [src]() { return to_unsigned(*src) + 1; };
+			} else {
+				auto *src = &wire[j - 1];
+				wire[j]   = [src]() { return to_unsigned(*src) ^ 0x9e3779b9u; };
+			}
+		}
+	}
+
+	void work() override {
+		for (std::size_t r = 0; r < regs; ++r)
+			reg[r] <= reg[r] + wire[r % wires];
+	}
+	void sync() override {
+		for (std::size_t r = 0; r < regs; ++r) Visitor::sync(reg[r]);
+		for (std::size_t j = 0; j < wires; ++j) Visitor::sync(wire[j]);
+	}
+	void plan(dark::SyncPlan &plan) override {
+		for (std::size_t r = 0; r < regs; ++r) plan.add(reg[r]);
+		for (std::size_t j = 0; j < wires; ++j) plan.add(wire[j]);
+	}
+	void probe(dark::ProbeList &list) override {
+		for (std::size_t r = 0; r < regs; ++r) list.push_back(dark::Probe::make(reg[r]));
+		for (std::size_t j = 0; j < wires; ++j) list.push_back(dark::Probe::make(wire[j]));
+	}
+};
+
+template<std::size_t _Len>
+struct Design {
+	std::vector<std::unique_ptr<Synthetic<_Len>>> modules;
+
+	explicit Design(const Options &options) {
+		for (std::size_t i = 0; i < options.modules; ++i)
+			modules.push_back(std::make_unique<Synthetic<_Len>>(options.regs, options.wires));
+		for (std::size_t i = 0; i < options.modules; ++i)
+			modules[i]->connect(*modules[(i + options.modules - 1) % options.modules], options.depth);
+	}
+
+	max_size_t checksum() const {
+		max_size_t sum = 0;
+		for (auto &module: modules)
+			for (std::size_t r = 0; r < module->regs; ++r) sum = sum * 31 + to_unsigned(module->reg[r]);
+		return sum;
+	}
+};
+
+void report(const char *name, unsigned long long cycles, double elapsed, max_size_t checksum) {
+	std::cout << name << ": " << static_cast<double>(cycles) / elapsed << " cycles/s"
+			  << " (checksum " << checksum << ")\n";
+}
+
+template<std::size_t _Len>
+void bench_synthetic(const Options &options) {
+	Design<_Len> design(options);
+	dark::CPU cpu;
+	options.configure(cpu);
+	for (auto &module: design.modules) cpu.add_module(module.get());
+
+	auto start = _Clock_t::now();
+	cpu.run(options.cycles);
+	report("synthetic", options.cycles, seconds_since(start), design.checksum());
+}
+
+/* The synthetic design on several thread counts, against 1 thread. */
+template<std::size_t _Len>
+void bench_threads(const Options &options) {
+	std::vector<std::size_t> counts = {1, 2, 4, 8, std::max<std::size_t>(std::thread::hardware_concurrency(), 1)};
+	std::sort(counts.begin(), counts.end());
+	counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+
+	double base = 0;
+	max_size_t expected = 0;
+	for (auto threads: counts) {
+		auto sweep    = options;
+		sweep.threads = threads;
+		Design<_Len> design(sweep);
+		dark::CPU cpu;
+		sweep.configure(cpu);
+		for (auto &module: design.modules) cpu.add_module(module.get());
+
+		auto start = _Clock_t::now();
+		cpu.run(sweep.cycles);
+		const double rate = static_cast<double>(sweep.cycles) / seconds_since(start);
+		if (threads == 1) {
+			base     = rate;
+			expected = design.checksum();
+		}
+		std::cout << "threads " << threads << ": " << rate << " cycles/s, speedup " << rate / base
+				  << (design.checksum() == expected ? "" : " (CHECKSUM MISMATCH)") << '\n';
+	}
+}
+
+/* Drive the phases by hand, to split the time of a cycle. */
+template<std::size_t _Len>
+void bench_phases(const Options &options) {
+	Design<_Len> design(options);
+	double work_time = 0, sync_time = 0;
+	for (unsigned long long c = 0; c < options.cycles; ++c) {
+		auto start = _Clock_t::now();
+		for (auto &module: design.modules) module->work();
+		auto middle = _Clock_t::now();
+		for (auto &module: design.modules) module->sync();
+		work_time += std::chrono::duration<double>(middle - start).count();
+		sync_time += seconds_since(middle);
+	}
+	std::cout << "sync phase share: " << 100 * sync_time / (work_time + sync_time)
+			  << "% (serial, full sync)\n";
+
+	/* The same syncs, through a flat plan instead of the sync() of each module. */
+	dark::SyncPlan plan;
+	for (auto &module: design.modules) {
+		plan.begin_module();
+		module->plan(plan);
+		plan.end_module();
+	}
+	auto start = _Clock_t::now();
+	for (unsigned long long c = 0; c < options.cycles; ++c) plan.run();
+	const double plan_time = seconds_since(start);
+	start = _Clock_t::now();
+	for (unsigned long long c = 0; c < options.cycles; ++c)
+		for (auto &module: design.modules) module->sync();
+	const double module_time = seconds_since(start);
+	std::cout << "sync plan: " << plan_time * 1e9 / static_cast<double>(options.cycles) << " ns per cycle (modules "
+			  << module_time * 1e9 / static_cast<double>(options.cycles) << " ns)\n";
+}
+
+/* Every wire is evaluated once per cycle, then synced. */
+template<std::size_t _Len>
+void bench_wire_read(const Options &options) {
+	Design<_Len> design(options);
+	max_size_t sum = 0;
+	auto start = _Clock_t::now();
+	for (unsigned long long c = 0; c < options.cycles; ++c) {
+		for (auto &module: design.modules)
+			for (std::size_t j = 0; j < module->wires; ++j) sum += to_unsigned(module->wire[j]);
+		for (auto &module: design.modules)
+			for (std::size_t j = 0; j < module->wires; ++j) Visitor::sync(module->wire[j]);
+	}
+	auto reads = static_cast<double>(options.cycles) * static_cast<double>(options.modules * options.wires);
+	std::cout << "wire read: " << seconds_since(start) * 1e9 / reads << " ns (evaluate and sync, checksum " << sum
+			  << ")\n";
+}
+
+/* Every register is written once per cycle, then committed. */
+template<std::size_t _Len>
+void bench_register_commit(const Options &options) {
+	Design<_Len> design(options);
+	auto start = _Clock_t::now();
+	for (unsigned long long c = 0; c < options.cycles; ++c) {
+		for (auto &module: design.modules)
+			for (std::size_t r = 0; r < module->regs; ++r) module->reg[r] <= c + r;
+		for (auto &module: design.modules)
+			for (std::size_t r = 0; r < module->regs; ++r) Visitor::sync(module->reg[r]);
+	}
+	auto commits = static_cast<double>(options.cycles) * static_cast<double>(options.modules * options.regs);
+	std::cout << "register commit: " << seconds_since(start) * 1e9 / commits << " ns (write and sync, checksum "
+			  << design.checksum() << ")\n";
+}
+
+/* The design of demo/alu.cpp. */
+struct AluInput {
+	Wire<8> opcode;
+	Wire<1> issue;
+	Wire<32> rs1;
+	Wire<32> rs2;
+};
+
+struct AluOutput {
+	Register<32> out;
+	Register<1> done;
+};
+
+struct AluModule : dark::Module<AluInput, AluOutput> {
+	void work() override {
+		if (issue) {
+			switch (to_unsigned(opcode) % 8) {
+				case 0: out <= (rs1 + rs2); break;
+				case 1: out <= (rs1 - rs2); break;
+				case 2: out <= (rs1 << rs2); break;
+				case 3: out <= (rs1 >> rs2); break;
+				case 4: out <= (rs1 & rs2); break;
+				case 5: out <= (rs1 | rs2); break;
+				case 6: out <= (rs1 ^ rs2); break;
+				default: out <= (to_signed(rs1) < to_signed(rs2)); break;
+			}
+			done <= 1;
+		} else {
+			done <= 0;
+		}
+	}
+};
+
+void bench_alu(const Options &options) {
+	struct Command {
+		max_size_t opcode, issue, rs1, rs2;
+	};
+	std::mt19937 engine(42);
+	std::vector<Command> commands(1024);
+	for (auto &cmd: commands)
+		cmd = {static_cast<max_size_t>(engine() % 8), engine() % 4 != 0,
+			   static_cast<max_size_t>(engine()), static_cast<max_size_t>(engine())};
+
+	const Command *current = commands.data();
+	AluModule alu;
+	alu.opcode = [&current]() { return current->opcode; };
+	alu.issue  = [&current]() { return current->issue; };
+	alu.rs1    = [&current]() { return current->rs1; };
+	alu.rs2    = [&current]() { return current->rs2; };
+
+	dark::CPU cpu;
+	options.configure(cpu);
+	cpu.add_module(&alu);
+
+	max_size_t sum = 0;
+	auto start = _Clock_t::now();
+	for (unsigned long long c = 0; c < options.cycles; ++c) {
+		current = &commands[c % commands.size()];
+		cpu.run_once();
+		sum += to_unsigned(alu.out);
+	}
+	report("alu demo", options.cycles, seconds_since(start), sum);
+}
+
+/* The design of demo/modules.cpp. */
+struct RegFile_Input {
+	Wire<5> rs1_index;
+	Wire<5> rs2_index;
+	Wire<5> wb_index;
+	Wire<1> wb_enable;
+	Wire<32> wb_data;
+};
+
+struct RegFile_Output {
+	Register<32> rs1_data;
+	Register<32> rs2_data;
+};
+
+struct RegFile_Private {
+	std::array<Register<32>, 32> regs;
+};
+
+struct RegFile : dark::Module<RegFile_Input, RegFile_Output, RegFile_Private> {
+	void work() override final {
+		rs1_data <= regs[to_unsigned(rs1_index)];
+		rs2_data <= regs[to_unsigned(rs2_index)];
+		if (wb_enable && wb_index != 0)
+			regs[to_unsigned(wb_index)] <= wb_data;
+	}
+};
+
+struct InsDecode_Input {
+	Wire<32> rs1_data;
+	Wire<32> rs2_data;
+};
+
+struct InsDecode_Output {
+	Register<5> rs1_index;
+	Register<5> rs2_index;
+	Register<5> wb_index;
+	Register<32> wb_data;
+	Register<1> wb_enable;
+	Register<32> lfsr;   // Replaces the commands read from stdin.
+	Register<32> result; // Replaces the values printed to stdout.
+};
+
+struct InsDecode : dark::Module<InsDecode_Input, InsDecode_Output> {
+	void work() override final {
+		auto x   = to_unsigned(lfsr) != 0 ? to_unsigned(lfsr) : 0xace1u;
+		auto bit = ((x >> 0) ^ (x >> 10) ^ (x >> 30) ^ (x >> 31)) & 1;
+		lfsr <= (x << 1 | bit);
+		if (x & 1) {
+			rs1_index <= (x >> 1);
+			rs2_index <= (x >> 6);
+			wb_index <= 0;
+			wb_data <= 0;
+			wb_enable <= 0;
+		} else {
+			rs1_index <= 0;
+			rs2_index <= 0;
+			wb_index <= (x >> 1);
+			wb_data <= (x >> 6);
+			wb_enable <= 1;
+		}
+		result <= (result ^ rs1_data) + rs2_data;
+	}
+};
+
+void bench_modules(const Options &options) {
+	InsDecode ins_decode;
+	RegFile reg_file;
+
+	dark::CPU cpu;
+	options.configure(cpu);
+	cpu.add_module(&ins_decode);
+	cpu.add_module(&reg_file);
+
+	reg_file.rs1_index  = ins_decode.rs1_index;
+	reg_file.rs2_index  = ins_decode.rs2_index;
+	reg_file.wb_index   = ins_decode.wb_index;
+	reg_file.wb_enable  = ins_decode.wb_enable;
+	reg_file.wb_data    = ins_decode.wb_data;
+	ins_decode.rs1_data = reg_file.rs1_data;
+	ins_decode.rs2_data = reg_file.rs2_data;
+
+	auto start = _Clock_t::now();
+	cpu.run(options.cycles);
+	report("modules demo", options.cycles, seconds_since(start), to_unsigned(ins_decode.result));
+}
+
+} // namespace
+
+template<std::size_t _Len>
+void bench_kernel(const Options &options) {
+	bench_synthetic<_Len>(options);
+	bench_phases<_Len>(options);
+	bench_wire_read<_Len>(options);
+	bench_register_commit<_Len>(options);
+	if (options.sweep) bench_threads<_Len>(options);
+}
+
+int main(int argc, char **argv) {
+	auto options = parse(argc, argv);
+	std::cout << "modules: " << options.modules << ", regs: " << options.regs
+			  << ", wires: " << options.wires << ", depth: " << options.depth
+			  << ", width: " << options.width << ", cycles: " << options.cycles
+			  << ", threads: " << options.threads << ", dirty: " << options.dirty
+			  << ", arena: " << options.arena << ", topo: " << options.topo
+			  << ", trace: " << options.trace
+#ifdef DARK_NATIVE_STORAGE
+			  << ", storage: native"
+#else
+			  << ", storage: bitfield"
+#endif
+			  << '\n';
+
+	switch (options.width) {
+		case 5: bench_kernel<5>(options); break;
+		case 16: bench_kernel<16>(options); break;
+		case 17: bench_kernel<17>(options); break;
+		case 32: bench_kernel<32>(options); break;
+		default: std::cerr << "Unsupported width: " << options.width << '\n'; return 1;
+	}
+	bench_alu(options);
+	bench_modules(options);
+	return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Usage: bench/reflect_compile.sh [compiler] [types]
+# Compile time of a translation unit against the member count of its
+# aggregates: each unit declares `types` structs of N registers, and syncs
+# and probes all of them, as the modules of a core would. Set INCLUDE to
+# time another copy of the headers.
+set -e
+CXX=${1:-${CXX:-c++}}
+TYPES=${2:-40}
+INCLUDE=${INCLUDE:-$(cd "$(dirname "$0")/.." && pwd)/include}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+printf '%8s %8s %10s\n' members types seconds
+for N in 1 8 14 16 32 48 64; do
+	{
+		echo '#include "tools.h"'
+		t=0
+		while [ $t -lt "$TYPES" ]; do
+			printf 'struct S%d {' $t
+			i=0
+			while [ $i -lt "$N" ]; do
+				printf ' Register<%d> r%d;' $((i % 32 + 1)) $i
+				i=$((i + 1))
+			done
+			echo ' };'
+			printf 'void f%d(S%d &s, dark::ProbeList &list) { dark::sync_member(s); dark::probe_member(s, list); }\n' $t $t
+			t=$((t + 1))
+		done
+	} > "$DIR/unit.cpp"
+	start=$(date +%s.%N)
+	if $CXX -std=c++20 -O2 -I"$INCLUDE" -c "$DIR/unit.cpp" -o "$DIR/unit.o" 2>/dev/null; then
+		end=$(date +%s.%N)
+		printf '%8d %8d %10s\n' "$N" "$TYPES" "$(awk "BEGIN { printf \"%.2f\", $end - $start }")"
+	else
+		printf '%8d %8d %10s\n' "$N" "$TYPES" failed
+	fi
+done
@@ -0,0 +1,196 @@
+/**
+ * Wide bit vector operator benchmark: vector kernels versus scalar kernels,
+ * for each operator on 128, 256 and 512 bits.
+ *
+ * Before timing, the vector kernels and find_lane are checked against the
+ * scalar ones on random operands, at widths which leave tails.
+ *
+ * Usage: bench_wide [rounds]
+ * Build with optimization and the target instruction set,
+ * e.g. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_FLAGS=-march=native.
+ */
+#include "tools.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+using dark::details::word_t;
+
+constexpr std::size_t kValues = 1024;
+
+template<std::size_t _Len>
+struct Data {
+	static constexpr std::size_t _Words = Bit<_Len>::_Words;
+
+	std::vector<Bit<_Len>> lhs, rhs;
+	std::vector<typename Bit<_Len>::_Array_t> lhs_words, rhs_words;
+
+	Data() {
+		std::mt19937_64 engine(_Len);
+		for (std::size_t i = 0; i < kValues; ++i) {
+			typename Bit<_Len>::_Array_t a, b;
+			for (auto &word: a) word = engine();
+			for (auto &word: b) word = engine();
+			if (i % 4 == 0) b = a; // Make some values equal.
+			lhs.emplace_back(a);
+			rhs.emplace_back(b);
+			lhs_words.push_back(lhs.back().words());
+			rhs_words.push_back(rhs.back().words());
+		}
+	}
+};
+
+/* Whether the vector kernels give the scalar results, on random words of _Len bits. */
+template<std::size_t _Len>
+bool check_width(std::mt19937_64 &engine) {
+	namespace kernel = dark::details::kernel;
+	namespace scalar = dark::details::scalar;
+	constexpr auto _Words = Bit<_Len>::_Words;
+	using _Array_t        = typename Bit<_Len>::_Array_t;
+
+	bool ok = true;
+	for (int round = 0; round < 1000; ++round) {
+		_Array_t a, b, vector, expected;
+		for (auto &word: a) word = engine();
+		b = a;
+		if (round % 2 == 0) { // Otherwise equal, or differing in one word, e.g. the tail.
+			for (auto &word: b) word = engine();
+		} else if (round % 4 == 1) {
+			b[engine() % _Words] ^= word_t{1} << (engine() % 64);
+		}
+		auto same = [&](const char *name) {
+			if (vector == expected) return;
+			std::cout << "check: " << name << " differs at " << _Len << " bits\n";
+			ok = false;
+		};
+#define CHECK_BINARY(name)                                        \
+		kernel::name<_Words>(vector.data(), a.data(), b.data());   \
+		scalar::name<_Words>(expected.data(), a.data(), b.data()); \
+		same(#name)
+
+		CHECK_BINARY(bit_and);
+		CHECK_BINARY(bit_or);
+		CHECK_BINARY(bit_xor);
+#undef CHECK_BINARY
+		kernel::bit_not<_Words>(vector.data(), a.data());
+		scalar::bit_not<_Words>(expected.data(), a.data());
+		same("bit_not");
+		if (kernel::equal<_Words>(a.data(), b.data()) != scalar::equal<_Words>(a.data(), b.data())) {
+			std::cout << "check: equal differs at " << _Len << " bits\n";
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/* Whether find_lane gives the scalar result, for counts leaving tails of each vector width. */
+bool check_find_lane(std::mt19937_64 &engine) {
+	namespace kernel = dark::details::kernel;
+	namespace scalar = dark::details::scalar;
+	bool ok = true;
+	for (std::size_t count = 0; count <= 140; ++count) {
+		std::vector<std::uint32_t> lanes(count);
+		for (int round = 0; round < 50; ++round) {
+			for (auto &lane: lanes) lane = static_cast<std::uint32_t>(engine() % 64); // Some repeat.
+			const auto key = static_cast<std::uint32_t>(engine() % 80);              // Some are absent.
+			if (kernel::find_lane(lanes.data(), count, key) != scalar::find_lane(lanes.data(), count, key)) {
+				std::cout << "check: find_lane differs at " << count << " lanes\n";
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+/* Time fn(i) over all values, `rounds` times. Return ns per call. */
+template<typename _Fn>
+double measure(unsigned long long rounds, _Fn fn) {
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long long r = 0; r < rounds; ++r)
+		for (std::size_t i = 0; i < kValues; ++i) fn(i);
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / static_cast<double>(rounds * kValues);
+}
+
+template<std::size_t _Len>
+void bench_width(unsigned long long rounds) {
+	namespace kernel = dark::details::kernel;
+	namespace scalar = dark::details::scalar;
+	constexpr auto _Words = Data<_Len>::_Words;
+
+	Data<_Len> data;
+	auto &[lhs, rhs, lw, rw] = data;
+	std::vector<typename Bit<_Len>::_Array_t> out(lw); // Each call reads the previous result.
+	std::vector<word_t> flag(kValues);
+
+	auto row = [&](const char *name, double vector, double scalar) {
+		word_t checksum = 0;
+		for (std::size_t i = 0; i < kValues; ++i) checksum += out[i][0] ^ out[i][_Words - 1] ^ flag[i];
+		std::cout << _Len << '\t' << name << '\t' << vector << '\t' << scalar << '\t' << scalar / vector << "x\t"
+				  << checksum << '\n';
+	};
+
+	/* Run the kernel of the operator in both versions, on the same data. */
+#define BENCH_BINARY(name, op)                                                                    \
+	row(#name, measure(rounds, [&](std::size_t i) { op<_Words>(out[i].data(), out[i].data(), rw[i].data()); }), \
+		measure(rounds, [&](std::size_t i) { scalar::name<_Words>(out[i].data(), out[i].data(), rw[i].data()); }))
+
+	BENCH_BINARY(bit_and, kernel::bit_and);
+	BENCH_BINARY(bit_or, kernel::bit_or);
+	BENCH_BINARY(bit_xor, kernel::bit_xor);
+#undef BENCH_BINARY
+
+	row("bit_not", measure(rounds, [&](std::size_t i) { kernel::bit_not<_Words>(out[i].data(), out[i].data()); }),
+		measure(rounds, [&](std::size_t i) { scalar::bit_not<_Words>(out[i].data(), out[i].data()); }));
+	row("equal", measure(rounds, [&](std::size_t i) { flag[i] += kernel::equal<_Words>(lw[i].data(), rw[i].data()); }),
+		measure(rounds, [&](std::size_t i) { flag[i] += scalar::equal<_Words>(lw[i].data(), rw[i].data()); }));
+	row("add", measure(rounds, [&](std::size_t i) { kernel::add<_Words>(out[i].data(), out[i].data(), rw[i].data(), 0); }),
+		measure(rounds, [&](std::size_t i) { scalar::add<_Words>(out[i].data(), out[i].data(), rw[i].data(), 0); }));
+
+	/* Whole operators, including the construction of the result. */
+	auto op = [&](const char *name, auto fn) {
+		std::vector<Bit<_Len>> result(lhs);
+		auto ns = measure(rounds, [&](std::size_t i) { result[i] = fn(result[i], rhs[i]); });
+		for (std::size_t i = 0; i < kValues; ++i) out[i] = result[i].words();
+		row(name, ns, ns);
+	};
+	op("a & b", [](auto &a, auto &b) { return a & b; });
+	op("a ^ b", [](auto &a, auto &b) { return a ^ b; });
+	op("a + b", [](auto &a, auto &b) { return a + b; });
+	op("a - b", [](auto &a, auto &b) { return a - b; });
+	op("a << 37", [](auto &a, auto &) { return a << 37; });
+	op("a >> 37", [](auto &a, auto &) { return a >> 37; });
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	unsigned long long rounds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000;
+
+	std::cout << "vector kernels: " << (DARK_SIMD ? "on" : "off")
+#if defined(__AVX512F__)
+			  << " (AVX-512F)"
+#elif defined(__AVX2__)
+			  << " (AVX2)"
+#elif DARK_SIMD
+			  << " (SSE2)"
+#endif
+			  << ", rounds: " << rounds << '\n';
+	std::mt19937_64 engine(1);
+	bool ok = check_width<65>(engine) & check_width<127>(engine) & check_width<128>(engine) &
+			  check_width<129>(engine) & check_width<257>(engine) & check_width<511>(engine) &
+			  check_width<512>(engine) & check_width<577>(engine) & check_find_lane(engine);
+	std::cout << "check against the scalar kernels: " << (ok ? "ok" : "FAILED") << '\n';
+	if (!ok) return 1;
+
+	std::cout << "bits\top\tvector ns\tscalar ns\tspeedup\tchecksum\n";
+	std::cout << "(rows with an operator time the whole operator, with the kernels in use)\n";
+	bench_width<128>(rounds);
+	bench_width<256>(rounds);
+	bench_width<512>(rounds);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * Wire read benchmark: inline function storage versus the former
+ * heap-allocated, virtually dispatched FuncImpl path.
+ *
+ * Usage: bench_wire [wires] [cycles]
+ * Build with optimization (e.g. -DCMAKE_BUILD_TYPE=Release).
+ */
+#include "tools.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace legacy {
+
+using dark::max_size_t;
+
+/* The wire implementation before inline storage, kept for comparison. */
+struct FuncBase {
+	virtual max_size_t call() const = 0;
+	virtual ~FuncBase() = default;
+};
+
+template<typename _Fn>
+struct FuncImpl final : FuncBase {
+	_Fn _M_lambda;
+	FuncImpl(_Fn fn) : _M_lambda(fn) {}
+	max_size_t call() const override { return static_cast<max_size_t>(this->_M_lambda()); }
+};
+
+template<std::size_t _Len>
+struct Wire {
+	std::unique_ptr<FuncBase> _M_func;
+	mutable max_size_t _M_cache : _Len;
+	mutable bool _M_holds;
+
+	Wire() : _M_func(), _M_cache(), _M_holds() {}
+
+	template<typename _Fn>
+	Wire &operator=(_Fn fn) {
+		this->_M_func.reset(new FuncImpl<_Fn>{fn});
+		this->_M_holds = false;
+		return *this;
+	}
+
+	void sync() { this->_M_holds = false; }
+
+	explicit operator max_size_t() const {
+		if (this->_M_holds == false) {
+			this->_M_holds = true;
+			this->_M_cache = this->_M_func->call();
+		}
+		return this->_M_cache;
+	}
+};
+
+} // namespace legacy
+
+namespace {
+
+struct Sync {
+	template<typename _Tp>
+	static void sync(_Tp &wire) { dark::Visitor::sync(wire); }
+	template<std::size_t _Len>
+	static void sync(legacy::Wire<_Len> &wire) { wire.sync(); }
+};
+
+/* Real designs connect wires with many distinct lambda types. */
+template<typename _Wire>
+void connect(_Wire &wire, max_size_t *ptr, std::size_t kind) {
+	switch (kind % 4) {
+		case 0: wire = [ptr]() { return *ptr; }; break;
+		case 1: wire = [ptr]() { return *ptr + 1; }; break;
+		case 2: wire = [ptr]() { return *ptr ^ 2; }; break;
+		default: wire = [ptr]() { return *ptr - 3; }; break;
+	}
+}
+
+/**
+ * Simulate `cycles` cycles where every wire is read twice and then synced.
+ * Return cycles per second, and the checksum of the values read.
+ */
+template<typename _Wire>
+double run(std::size_t count, unsigned long long cycles, max_size_t &checksum) {
+	std::vector<max_size_t> source(count);
+	auto wires = std::make_unique<_Wire[]>(count);
+	for (std::size_t i = 0; i < count; ++i) {
+		source[i] = static_cast<max_size_t>(i);
+		connect(wires[i], &source[i], i);
+	}
+
+	checksum  = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long long c = 0; c < cycles; ++c) {
+		for (std::size_t i = 0; i < count; ++i) {
+			checksum += static_cast<max_size_t>(wires[i]);
+			checksum = checksum * 31 ^ static_cast<max_size_t>(wires[i]);
+		}
+		for (std::size_t i = 0; i < count; ++i)
+			Sync::sync(wires[i]);
+		source[c % count] += 1;
+	}
+	auto finish = std::chrono::steady_clock::now();
+
+	std::chrono::duration<double> elapsed = finish - start;
+	return static_cast<double>(cycles) / elapsed.count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	std::size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+	unsigned long long cycles = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+
+	max_size_t legacy_sum = 0, sum = 0;
+	double before = run<legacy::Wire<32>>(count, cycles, legacy_sum);
+	double after  = run<dark::Wire<32>>(count, cycles, sum);
+
+	std::cout << "wires: " << count << ", cycles: " << cycles << '\n';
+	std::cout << "FuncImpl (heap + virtual): " << before << " cycles/s\n";
+	std::cout << "FuncStorage (inline):      " << after << " cycles/s\n";
+	std::cout << "speedup: " << after / before << "x\n";
+	std::cout << "checksum: " << legacy_sum << (legacy_sum == sum ? " (same)" : " (MISMATCH)") << '\n';
+	return 0;
+}
@@ -0,0 +1,178 @@
+#include "tools.h"
+#include "cache.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+using _Clock_t = std::chrono::steady_clock;
+
+struct Xorshift {
+	std::uint64_t x;
+	std::uint64_t operator()() { return x ^= x << 13, x ^= x >> 7, x ^= x << 17; }
+};
+
+struct Tester_Input {
+	Wire <1> ready;
+	Wire <1> done;
+	Wire <8> answer;	// Id of the request done.
+	Wire <32> rdata;
+};
+
+struct Tester_Output {
+	Register <1> valid;
+	Register <1> write;
+	Register <2> size;
+	Register <32> addr;
+	Register <32> wdata;
+	Register <8> id;
+};
+
+// Sends random loads and stores, and checks each load against a reference
+// memory, updated when the cache takes the request.
+struct Tester : dark::Module <Tester_Input, Tester_Output> {
+	dark::Memory *reference = nullptr;
+	std::uint32_t span = 1 << 16; // Bytes of the working set.
+	Xorshift random{1};
+	std::array<std::uint32_t, 256> expected{};
+	std::array<bool, 256> pending{};
+	unsigned long long sent = 0, answered = 0, errors = 0, limit = ~0ull;
+
+	void work() override final {
+		if (done) {
+			const auto i = to_unsigned(answer);
+			if (!pending[i] || to_unsigned(rdata) != expected[i]) ++errors;
+			pending[i] = false;
+			++answered;
+		}
+		if (valid && ready) ++sent; // Taken in this cycle.
+		if (valid && ready == 0) return; // Hold the request.
+		const auto next = static_cast<std::uint32_t>(sent % 256);
+		if (sent == limit || pending[next]) {
+			if (valid) valid <= 0;
+			return;
+		}
+		const auto r     = random();
+		const auto bytes = (r & 3) == 3 ? 4u : 1u << (r & 3); // Size 3 is a word, as 2.
+		const auto where = static_cast<std::uint32_t>((r >> 8) % span) & ~(bytes - 1);
+		const bool store = (r >> 4 & 3) == 0;
+		const auto value = static_cast<std::uint32_t>(r >> 32);
+		if (store) {
+			reference->write(where, &value, bytes);
+			expected[next] = 0;
+		} else {
+			expected[next] = 0;
+			reference->read(where, &expected[next], bytes);
+		}
+		pending[next] = true;
+		valid <= 1;
+		write <= store;
+		size <= (r & 3);
+		addr <= where;
+		wdata <= value;
+		id <= next;
+	}
+};
+
+struct System {
+	dark::Memory memory, reference;
+	dark::MainMemory main{memory, 100};
+	dark::Cache l2;
+	dark::CachePort l1;
+	Tester tester;
+	dark::CPU cpu;
+
+	System(const dark::CacheConfig &l1_config, const dark::CacheConfig &l2_config)
+		: l2(l2_config, main), l1(l1_config, l2) {
+		tester.reference = &reference;
+		l1.valid = tester.valid;
+		l1.write = tester.write;
+		l1.size  = tester.size;
+		l1.addr  = tester.addr;
+		l1.wdata = tester.wdata;
+		l1.id    = tester.id;
+		tester.ready = l1.ready;
+		tester.done  = l1.done;
+		tester.answer = l1.rid;
+		tester.rdata = l1.rdata;
+		cpu.add_module(&tester);
+		cpu.add_module(&l1);
+	}
+
+	// The memory after all dirty lines are written back, against the reference.
+	bool consistent(std::uint32_t span) {
+		l1.cache().flush();
+		l2.flush();
+		for (std::uint32_t i = 0; i < span; i += 4)
+			if (memory.load<std::uint32_t>(i) != reference.load<std::uint32_t>(i)) return false;
+		return true;
+	}
+};
+
+static void print(const char *name, const dark::CacheStats &s) {
+	std::cout << "  " << name << ": " << s.reads + s.writes << " accesses, hit rate "
+			  << 100.0 * s.hits() / std::max<std::uint64_t>(1, s.reads + s.writes) << "%, " << s.evictions
+			  << " evictions, " << s.writebacks << " writebacks";
+	if (s.merged != 0 || s.stalls != 0) std::cout << ", " << s.merged << " merged, " << s.stalls << " stall cycles";
+	std::cout << '\n';
+}
+
+// Usage: cache [requests]
+// Runs random traffic through an L1 cache module and an L2, in several
+// configurations, and checks every load and the final memory against a
+// reference. Then times the tag lookup of the arrays at several ways.
+signed main(int argc, char **argv) {
+	const unsigned long long requests = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+	struct Setup {
+		const char *name;
+		dark::CacheConfig l1;
+		std::uint32_t span;
+	};
+	const Setup setups[] = {
+		{"8 KiB 2-way LRU write-back", {.size = 8 << 10, .ways = 2, .line = 32}, 32 << 10},
+		{"32 KiB 8-way FIFO write-through", {.size = 32 << 10, .ways = 8, .replacement = dark::CacheReplacement::Fifo, .write_back = false}, 64 << 10},
+		{"64 KiB 16-way random, 8 MSHRs", {.size = 64 << 10, .ways = 16, .replacement = dark::CacheReplacement::Random, .mshrs = 8}, 1 << 20},
+		{"4 KiB direct mapped, 1 MSHR", {.size = 4 << 10, .ways = 1, .line = 16, .mshrs = 1}, 16 << 10},
+	};
+	const dark::CacheConfig l2_config{.size = 256 << 10, .ways = 16, .line = 64, .hit_latency = 12};
+
+	bool failed = false;
+	for (auto &setup: setups) {
+		auto system = std::make_unique<System>(setup.l1, l2_config);
+		system->tester.span  = setup.span;
+		system->tester.limit = requests;
+		system->cpu.enable_clock_gating();
+		const auto start = _Clock_t::now();
+		while (system->tester.answered < requests) system->cpu.run_once();
+		std::chrono::duration<double> elapsed = _Clock_t::now() - start;
+		const bool ok = system->tester.errors == 0 && system->consistent(setup.span);
+		failed = failed || !ok;
+		std::cout << setup.name << ": " << (ok ? "ok" : "MISMATCH") << ", " << system->cpu.cycles << " cycles, "
+				  << double(system->cpu.cycles) / requests << " cycles per request, "
+				  << system->cpu.cycles / elapsed.count() / 1e6 << " M cycles/s\n";
+		print("l1", system->l1.stats());
+		print("l2", system->l2.stats());
+	}
+
+	// Lookups in the arrays alone, with every line present.
+	for (std::uint32_t ways: {1u, 4u, 8u, 16u}) {
+		dark::Memory memory;
+		dark::MainMemory main(memory);
+		dark::Cache cache({.size = 64 << 10, .ways = ways}, main);
+		std::uint32_t value = 0;
+		for (std::uint32_t i = 0; i < (64 << 10); i += 4) memory.store<std::uint32_t>(i, i);
+		for (std::uint32_t i = 0; i < (64 << 10); i += 64) cache.read(i, &value, 4);
+		Xorshift random{7};
+		std::uint32_t sum = 0;
+		const std::size_t count = 10000000;
+		const auto start = _Clock_t::now();
+		for (std::size_t i = 0; i < count; ++i) {
+			cache.access(static_cast<std::uint32_t>(random()) & 0xfffc, &value, 4, false);
+			sum += value;
+		}
+		std::chrono::duration<double, std::nano> elapsed = _Clock_t::now() - start;
+		std::cout << ways << " ways: " << elapsed.count() / count << " ns per hit (sum " << sum << ")\n";
+	}
+	return failed ? 1 : 0;
+}
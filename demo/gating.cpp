@@ -0,0 +1,325 @@
+#include "tools.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+constexpr std::size_t kDividers = 16;
+constexpr std::size_t kWalkers  = 4;
+constexpr std::size_t kEntries  = 16; // Walk cache entries of a walker.
+
+struct Issuer_Input {};
+
+struct Issuer_Output {
+	Register <1> start;		// A request is issued in this cycle.
+	Register <4> target;	// Divider of the request.
+	Register <32> dividend;
+	Register <32> divisor;
+	Register <1> walk;		// A page walk is issued in this cycle.
+	Register <2> walker;	// Walker of the request.
+	Register <32> vaddr;
+};
+
+struct Issuer_Private {
+	Register <32> lfsr;
+};
+
+// Issues a division to a random divider about once in 16 cycles,
+// and a page walk to a random walker about once in 32 cycles.
+struct Issuer : dark::Module <Issuer_Input, Issuer_Output, Issuer_Private> {
+	void work() override final {
+		max_size_t x = to_unsigned(lfsr);
+		x = x == 0 ? 0x2545f491 : x;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		lfsr <= x;
+		if ((x & 15) == 0) {
+			start <= 1;
+			target <= (x >> 4) % kDividers;
+			dividend <= x;
+			divisor <= ((x >> 20) | 1);
+		} else if (start) {
+			start <= 0;
+		}
+		if ((x >> 27) == 0) {
+			walk <= 1;
+			walker <= (x >> 8) % kWalkers;
+			vaddr <= (x & 0x7fffff); // A small working set of pages.
+		} else if (walk) {
+			walk <= 0;
+		}
+	}
+};
+
+struct Divider_Input {
+	Wire <1> start;
+	Wire <4> target;
+	Wire <32> dividend;
+	Wire <32> divisor;
+};
+
+struct Divider_Output {
+	Register <1> done;		// The quotient is ready, for one cycle.
+	Register <32> quotient;
+};
+
+struct Divider_Private {
+	Register <1> busy;
+	Register <6> count;
+	Register <32> rem;
+	Register <32> quo;
+	Register <32> div;
+};
+
+// A restoring divider, one bit per cycle. Idle most of the time.
+// Written like RTL: the next state is computed every cycle, then selected.
+struct Divider : dark::Module <Divider_Input, Divider_Output, Divider_Private> {
+	max_size_t id = 0;
+
+	void work() override final {
+		const bool accept = busy == 0 && start && to_unsigned(target) == id;
+		const max_size_t shifted = (to_unsigned(rem) << 1) | (to_unsigned(quo) >> 31);
+		const bool fits = shifted >= to_unsigned(div);
+		const max_size_t next_rem = fits ? shifted - to_unsigned(div) : shifted;
+		const max_size_t next_quo = (to_unsigned(quo) << 1) | (fits ? 1 : 0);
+		const bool last = busy && count == 1;
+
+		if (busy) {
+			rem <= next_rem;
+			quo <= next_quo;
+			count <= count - 1;
+		}
+		if (accept) {
+			busy <= 1;
+			count <= 32;
+			rem <= 0;
+			quo <= dividend;
+			div <= divisor;
+		}
+		if (last) {
+			busy <= 0;
+			quotient <= next_quo;
+		}
+		if (last != (done != 0)) done <= last;
+	}
+
+	// The operands only matter along with a change of start or target.
+	void sensitivity(dark::ProbeList &list) override {
+		list.push_back(dark::Probe::make(start));
+		list.push_back(dark::Probe::make(target));
+	}
+	// Same inputs as at the last run, and nothing in flight: work() writes nothing.
+	bool quiescent() const override { return busy == 0 && done == 0; }
+};
+
+struct Walker_Input {
+	Wire <1> start;
+	Wire <2> target;
+	Wire <32> vaddr;
+};
+
+struct Walker_Output {
+	Register <1> done;		// The translation is ready, for one cycle.
+	Register <32> paddr;
+};
+
+struct Walker_Private {
+	std::array <Register <20>, kEntries> tags;	// Virtual page numbers.
+	std::array <Register <20>, kEntries> pages;	// Physical page numbers.
+	std::array <Register <1>, kEntries> valid;
+	Register <4> victim;
+	Register <1> busy;
+	Register <5> count;		// Cycles left in the walk.
+	Register <32> vaddr_q;
+};
+
+// A page-table walker with a small walk cache: a hit answers in one cycle,
+// a miss walks the table for 24 cycles. Like RTL, the cache is looked up in
+// every cycle, requested or not.
+struct Walker : dark::Module <Walker_Input, Walker_Output, Walker_Private> {
+	max_size_t id = 0;
+
+	static max_size_t translate(max_size_t vpn) { return (vpn * 0x9e37u + 0x51) & 0xfffff; }
+
+	void work() override final {
+		const max_size_t vpn = to_unsigned(vaddr) >> 12;
+		std::size_t hit = kEntries;
+		for (std::size_t i = 0; i < kEntries; ++i)
+			if (valid[i] && to_unsigned(tags[i]) == vpn) hit = i;
+		const bool accept = busy == 0 && start && to_unsigned(target) == id;
+		const bool last = busy && count == 1;
+		const max_size_t miss_vpn = to_unsigned(vaddr_q) >> 12;
+
+		if (accept && hit != kEntries) {
+			paddr <= (to_unsigned(pages[hit]) << 12 | (to_unsigned(vaddr) & 0xfff));
+		} else if (accept) {
+			busy <= 1;
+			count <= 24;
+			vaddr_q <= vaddr;
+		}
+		if (busy) count <= count - 1;
+		if (last) {
+			const auto slot = to_unsigned(victim);
+			busy <= 0;
+			tags[slot] <= miss_vpn;
+			pages[slot] <= translate(miss_vpn);
+			if (valid[slot] == 0) valid[slot] <= 1;
+			victim <= slot + 1;
+			paddr <= (translate(miss_vpn) << 12 | (to_unsigned(vaddr_q) & 0xfff));
+		}
+		const bool finish = last || (accept && hit != kEntries);
+		if (finish != (done != 0)) done <= finish;
+	}
+
+	void sensitivity(dark::ProbeList &list) override {
+		list.push_back(dark::Probe::make(start));
+		list.push_back(dark::Probe::make(target));
+	}
+	bool quiescent() const override { return busy == 0 && done == 0; }
+};
+
+struct Sum_Input {
+	std::array <Wire <1>, kDividers> done;
+	std::array <Wire <32>, kDividers> quotient;
+	std::array <Wire <1>, kWalkers> walked;
+	std::array <Wire <32>, kWalkers> paddr;
+};
+
+struct Sum_Output {
+	Register <32> sum;
+	Register <32> count;
+};
+
+// Collects the results. It always runs.
+struct Sum : dark::Module <Sum_Input, Sum_Output> {
+	void work() override final {
+		max_size_t s = 0, n = 0;
+		for (std::size_t i = 0; i < kDividers; ++i) {
+			if (done[i]) {
+				s += to_unsigned(quotient[i]);
+				++n;
+			}
+		}
+		for (std::size_t i = 0; i < kWalkers; ++i) {
+			if (walked[i]) {
+				s += to_unsigned(paddr[i]);
+				++n;
+			}
+		}
+		if (n != 0) {
+			sum <= sum + s;
+			count <= count + n;
+		}
+	}
+};
+
+struct System {
+	Issuer issuer;
+	std::array <Divider, kDividers> dividers;
+	std::array <Walker, kWalkers> walkers;
+	Sum sum;
+	dark::CPU cpu;
+
+	System() {
+		cpu.add_module(&issuer);
+		for (std::size_t i = 0; i < kDividers; ++i) {
+			auto &divider = dividers[i];
+			divider.id = i;
+			divider.start = issuer.start;
+			divider.target = issuer.target;
+			divider.dividend = issuer.dividend;
+			divider.divisor = issuer.divisor;
+			sum.done[i] = divider.done;
+			sum.quotient[i] = divider.quotient;
+			cpu.add_module(&divider);
+		}
+		for (std::size_t i = 0; i < kWalkers; ++i) {
+			auto &walker = walkers[i];
+			walker.id = i;
+			walker.start = issuer.walk;
+			walker.target = issuer.walker;
+			walker.vaddr = issuer.vaddr;
+			sum.walked[i] = walker.done;
+			sum.paddr[i] = walker.paddr;
+			cpu.add_module(&walker);
+		}
+		cpu.add_module(&sum);
+	}
+
+	// Values of all registers, in module order.
+	std::vector<max_size_t> state() {
+		std::vector<max_size_t> values;
+		dark::ProbeList list;
+		issuer.probe(list);
+		for (auto &divider: dividers) divider.probe(list);
+		for (auto &walker: walkers) walker.probe(list);
+		sum.probe(list);
+		for (auto &probe: list)
+			if (probe.kind == dark::Probe::Kind::Register) values.push_back(probe.read());
+		return values;
+	}
+};
+
+// Usage: gating [cycles] [seed]
+// Differential check of clock gating: the same design runs with and
+// without it, in lockstep, and the registers must match after each cycle.
+// Then both are timed.
+signed main(int argc, char **argv) {
+	using _Clock_t = std::chrono::steady_clock;
+	const unsigned long long cycles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+	const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+
+	struct Mode {
+		const char *name;
+		bool shuffle;
+		bool dirty;
+		std::size_t threads;
+	};
+	const Mode modes[] = {
+			{"serial", false, false, 1},
+			{"shuffled", true, false, 1},
+			{"dirty", false, true, 1},
+			{"threads", true, false, 2},
+	};
+
+	bool failed = false;
+	for (auto &mode: modes) {
+		auto always = std::make_unique<System>();
+		auto gated  = std::make_unique<System>();
+		for (auto *system: {always.get(), gated.get()}) {
+			system->cpu.set_seed(seed);
+			system->cpu.enable_dirty_sync(mode.dirty);
+			system->cpu.set_threads(mode.threads);
+		}
+		gated->cpu.enable_clock_gating();
+
+		unsigned long long diverged = 0;
+		for (unsigned long long c = 1; c <= cycles && diverged == 0; ++c) {
+			for (auto *system: {always.get(), gated.get()})
+				mode.shuffle ? system->cpu.run_once_shuffle() : system->cpu.run_once();
+			if (always->state() != gated->state()) diverged = c;
+		}
+
+		unsigned long long skipped = 0;
+		for (auto count: gated->cpu.gated_cycles()) skipped += count;
+		const auto runs = cycles * (kDividers + kWalkers + 2);
+		if (diverged != 0) {
+			failed = true;
+			std::cout << mode.name << ": MISMATCH at cycle " << diverged << '\n';
+		} else {
+			std::cout << mode.name << ": match over " << cycles << " cycles, " << 100.0 * skipped / runs
+					  << "% of work() skipped (sum " << to_unsigned(gated->sum.sum) << ")\n";
+		}
+	}
+
+	for (bool gating: {false, true}) {
+		auto system = std::make_unique<System>();
+		system->cpu.enable_clock_gating(gating);
+		auto start = _Clock_t::now();
+		system->cpu.run(cycles * 10);
+		std::chrono::duration<double> elapsed = _Clock_t::now() - start;
+		std::cout << (gating ? "gated" : "always") << ": " << cycles * 10 / elapsed.count() << " cycles/s\n";
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+#include "tools.h"
+#include "cosim.h"
+#include "iss.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// A tiny assembler for the demo program, with labels resolved at the end.
+struct Assembler {
+	std::vector<std::uint32_t> code;
+	std::vector<std::uint32_t> labels;
+	struct Fixup {
+		std::size_t at;
+		std::size_t label;
+	};
+	std::vector<Fixup> fixups;
+
+	std::size_t label() {
+		labels.push_back(~0u);
+		return labels.size() - 1;
+	}
+	void bind(std::size_t l) { labels[l] = static_cast<std::uint32_t>(code.size() * 4); }
+
+	void r(std::uint32_t f7, std::uint32_t rs2, std::uint32_t rs1, std::uint32_t f3, std::uint32_t rd, std::uint32_t op) {
+		code.push_back(f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op);
+	}
+	void i(std::int32_t imm, std::uint32_t rs1, std::uint32_t f3, std::uint32_t rd, std::uint32_t op) {
+		code.push_back(static_cast<std::uint32_t>(imm) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op);
+	}
+	void s(std::int32_t imm, std::uint32_t rs2, std::uint32_t rs1, std::uint32_t f3) {
+		const auto u = static_cast<std::uint32_t>(imm);
+		code.push_back((u >> 5) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (u & 31) << 7 | 0x23);
+	}
+	void b(std::uint32_t f3, std::uint32_t rs1, std::uint32_t rs2, std::size_t target) {
+		fixups.push_back({code.size(), target});
+		code.push_back(rs2 << 20 | rs1 << 15 | f3 << 12 | 0x63);
+	}
+	void jal(std::uint32_t rd, std::size_t target) {
+		fixups.push_back({code.size(), target});
+		code.push_back(rd << 7 | 0x6f);
+	}
+	void lui(std::uint32_t rd, std::uint32_t imm) { code.push_back((imm << 12) | rd << 7 | 0x37); }
+	void addi(std::uint32_t rd, std::uint32_t rs1, std::int32_t imm) { i(imm, rs1, 0, rd, 0x13); }
+	void add(std::uint32_t rd, std::uint32_t rs1, std::uint32_t rs2) { r(0, rs2, rs1, 0, rd, 0x33); }
+	void mul(std::uint32_t rd, std::uint32_t rs1, std::uint32_t rs2) { r(1, rs2, rs1, 0, rd, 0x33); }
+	void remu(std::uint32_t rd, std::uint32_t rs1, std::uint32_t rs2) { r(1, rs2, rs1, 7, rd, 0x33); }
+	void lbu(std::uint32_t rd, std::uint32_t rs1, std::int32_t imm) { i(imm, rs1, 4, rd, 0x03); }
+	void sb(std::uint32_t rs2, std::uint32_t rs1, std::int32_t imm) { s(imm, rs2, rs1, 0); }
+	void sw(std::uint32_t rs2, std::uint32_t rs1, std::int32_t imm) { s(imm, rs2, rs1, 2); }
+	void fence(std::uint32_t rd) { i(0x0ff, 0, 0, rd, 0x0f); }
+	void ecall() { code.push_back(0x73); }
+
+	std::vector<std::uint32_t> finish() {
+		for (auto [at, label]: fixups) {
+			const auto offset = labels[label] - static_cast<std::uint32_t>(at * 4);
+			auto &word = code[at];
+			if ((word & 0x7f) == 0x6f) {
+				word |= ((offset >> 20) & 1) << 31 | ((offset >> 1) & 0x3ff) << 21 | ((offset >> 11) & 1) << 20 |
+						((offset >> 12) & 0xff) << 12;
+			} else {
+				word |= ((offset >> 12) & 1) << 31 | ((offset >> 5) & 0x3f) << 25 | ((offset >> 1) & 15) << 8 |
+						((offset >> 11) & 1) << 7;
+			}
+		}
+		return code;
+	}
+};
+
+enum : std::uint32_t { zero = 0, ra = 1, t0 = 5, t1 = 6, t2 = 7, s0 = 8, s1 = 9, a0 = 10, a1 = 11, a2 = 12, a3 = 13, s2 = 18, s3 = 19 };
+
+// Sieve of Eratosthenes over 64 KiB, `rounds` times, with a checksum of the primes.
+std::vector<std::uint32_t> program(std::int32_t rounds) {
+	Assembler as;
+	auto round = as.label(), clear = as.label(), outer = as.label(), inner = as.label(), next = as.label(),
+		 sieved = as.label(), count = as.label(), skip = as.label(), end = as.label();
+	as.lui(s0, 0x10);		// s0 = sieve base
+	as.lui(s1, 0x10);		// s1 = N
+	as.addi(s2, zero, rounds);
+	as.addi(s3, zero, 1);
+	as.addi(a0, zero, 0);	// a0 = primes found
+	as.addi(a1, zero, 0);	// a1 = checksum
+	as.addi(a2, zero, 31);
+	as.addi(a3, zero, 1000);
+	as.bind(round);
+	as.b(0, s2, zero, end);
+	as.addi(s2, s2, -1);
+	as.addi(t0, zero, 0);
+	as.bind(clear);			// Clear the sieve, a word at a time.
+	as.add(t2, s0, t0);
+	as.sw(zero, t2, 0);
+	as.addi(t0, t0, 4);
+	as.b(6, t0, s1, clear);
+	as.addi(t0, zero, 2);
+	as.bind(outer);
+	as.mul(t1, t0, t0);
+	as.b(7, t1, s1, sieved);
+	as.add(t2, s0, t0);
+	as.lbu(t2, t2, 0);
+	as.b(1, t2, zero, next);
+	as.bind(inner);
+	as.b(7, t1, s1, next);
+	as.add(t2, s0, t1);
+	as.sb(s3, t2, 0);
+	as.add(t1, t1, t0);
+	as.jal(zero, inner);
+	as.bind(next);
+	as.addi(t0, t0, 1);
+	as.jal(zero, outer);
+	as.bind(sieved);
+	as.addi(t0, zero, 2);
+	as.bind(count);
+	as.b(7, t0, s1, round);
+	as.add(t2, s0, t0);
+	as.lbu(t2, t2, 0);
+	as.b(1, t2, zero, skip);
+	as.addi(a0, a0, 1);
+	as.mul(a1, a1, a2);
+	as.remu(t2, t0, a3);
+	as.add(a1, a1, t2);
+	as.bind(skip);
+	as.addi(t0, t0, 1);
+	as.jal(zero, count);
+	as.bind(end);
+	as.ecall();
+	return as.finish();
+}
+
+struct Core_Input {};
+
+struct Core_Output {
+	Register <32> pc;
+	Register <1> halted;
+};
+
+struct Core_Private {
+	std::array <Register <32>, 32> regs;
+};
+
+// A cycle model which retires one instruction per cycle, with its own
+// execute stage. Memory lives in an Iss object, used as storage only.
+struct Core : dark::Module <Core_Input, Core_Output, Core_Private> {
+	dark::Iss *memory = nullptr;
+	dark::Cosim *cosim = nullptr;	// Checks each retired instruction, if set.
+	unsigned long long retired = 0;
+	unsigned long long bug = 0;		// Corrupt the register write of this instruction, if not 0.
+
+	void work() override final {
+		using dark::iss::Op;
+		if (halted) return;
+		const auto addr = to_unsigned(pc);
+		const auto insn = memory->load_word(addr);
+		const auto d = dark::iss::decode(insn);
+		const auto a = to_unsigned(regs[d.rs1]);
+		const auto b = to_unsigned(regs[d.rs2]);
+		const auto imm = d.imm;
+		max_size_t next = addr + 4;
+		bool write = true;
+		std::uint8_t store = 0;
+		max_size_t value = 0;
+		switch (d.op) {
+			case Op::Lui: value = imm; break;
+			case Op::Addi: value = a + imm; break;
+			case Op::Add: value = a + b; break;
+			case Op::Mul: value = a * b; break;
+			case Op::Remu: value = b == 0 ? a : a % b; break;
+			case Op::Lbu: {
+				std::uint8_t byte;
+				memory->read(a + imm, &byte, 1);
+				value = byte;
+				break;
+			}
+			case Op::Sb: {
+				const auto byte = static_cast<std::uint8_t>(b);
+				memory->write(a + imm, &byte, 1);
+				write = false, store = 1;
+				break;
+			}
+			case Op::Sw:
+				memory->write(a + imm, &b, 4);
+				write = false, store = 4;
+				break;
+			case Op::Jal: value = addr + 4, next = addr + imm; break;
+			case Op::Beq: write = false, next = a == b ? addr + imm : next; break;
+			case Op::Bne: write = false, next = a != b ? addr + imm : next; break;
+			case Op::Bltu: write = false, next = a < b ? addr + imm : next; break;
+			case Op::Bgeu: write = false, next = a >= b ? addr + imm : next; break;
+			case Op::Ecall: write = false, halted <= 1; break;
+			default: dark::debug::assert(false, "Core: unsupported instruction"); break;
+		}
+		if (++retired == bug) value ^= 1 << 4;
+		if (write && d.rd != dark::iss::kSink) regs[d.rd] <= value;
+		pc <= next;
+		if (cosim != nullptr) {
+			dark::Commit commit;
+			commit.cycle = retired;
+			commit.pc = addr;
+			commit.insn = insn;
+			if (write && d.rd != dark::iss::kSink) commit.rd = d.rd, commit.value = value;
+			if (store != 0) commit.store = store, commit.addr = a + imm, commit.data = b;
+			if (!cosim->check(commit)) halted <= 1;
+		}
+	}
+
+	void hand_over(const dark::IssState &state) { dark::hand_over(state, regs, pc); }
+	max_size_t reg(std::size_t i) const { return to_unsigned(regs[i]); }
+	max_size_t pc_value() const { return to_unsigned(pc); }
+};
+
+// Usage: iss [rounds] [fast-forward] [bug]
+// Runs a sieve program on the ISS, then fast-forwards a second ISS over
+// the first instructions, hands its state to a cycle model, and checks
+// the cycle model against the first ISS up to the end. Then runs the
+// cycle model again in lockstep with an ISS, which checks each retired
+// instruction; with a bug, the register write of that instruction (after
+// the fast-forward) is corrupted, and the divergence is reported. Last,
+// checks that a FENCE with a nonzero rd leaves the register alone.
+signed main(int argc, char **argv) {
+	using _Clock_t = std::chrono::steady_clock;
+	const auto rounds = argc > 1 ? std::atoi(argv[1]) : 20;
+	const auto code = program(rounds);
+	auto make = [&code]() {
+		auto iss = std::make_unique<dark::Iss>();
+		iss->write(0, code.data(), code.size() * 4);
+		return iss;
+	};
+
+	auto reference = make();
+	auto start = _Clock_t::now();
+	reference->run(~0ull);
+	std::chrono::duration<double> elapsed = _Clock_t::now() - start;
+	std::cout << "iss: " << reference->instret() << " instructions in " << elapsed.count() << " s, "
+			  << reference->instret() / elapsed.count() / 1e6 << " MIPS (primes " << reference->reg(a0)
+			  << ", checksum " << reference->reg(a1) << ")\n";
+
+	const auto forward = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : reference->instret() * 9 / 10;
+	const auto bug = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0;
+	bool failed = false;
+	for (bool lockstep: {false, true}) {
+		auto fast = make();
+		fast->run(forward);
+		auto golden = make();
+		golden->run(forward);
+		dark::Cosim cosim(*golden);
+
+		Core core;
+		core.memory = fast.get();
+		if (lockstep) core.cosim = &cosim, core.bug = bug;
+		dark::CPU cpu;
+		cpu.add_module(&core);
+		core.hand_over(fast->state());
+		start = _Clock_t::now();
+		while (core.halted == 0) cpu.run_once();
+		elapsed = _Clock_t::now() - start;
+
+		bool match = core.pc_value() == reference->pc();
+		for (std::size_t i = 0; i < 32; ++i) match = match && core.reg(i) == reference->reg(i);
+		std::cout << (lockstep ? "cycle model, lockstep: " : "cycle model: ") << core.retired
+				  << " instructions after " << forward << " on the ISS, " << core.retired / elapsed.count() / 1e6
+				  << " MIPS, " << (match ? "state matches" : "MISMATCH") << '\n';
+		if (lockstep) cosim.report(std::cout);
+		failed = failed || !match || cosim.diverged();
+	}
+
+	{	// A FENCE with a nonzero rd (reserved bits) must leave the register alone.
+		Assembler as;
+		as.addi(a1, zero, 42);
+		as.fence(a1);
+		as.ecall();
+		const auto fence = as.finish();
+		dark::Iss iss;
+		iss.write(0, fence.data(), fence.size() * 4);
+		iss.run(~0ull);
+		const bool ok = iss.reg(a1) == 42;
+		std::cout << "fence with rd: " << (ok ? "ok" : "MISMATCH") << '\n';
+		failed = failed || !ok;
+	}
+	return failed ? 1 : 0;
+}
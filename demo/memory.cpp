@@ -0,0 +1,243 @@
+#include "tools.h"
+#include "memory.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using _Clock_t = std::chrono::steady_clock;
+
+static double since(_Clock_t::time_point start) {
+	return std::chrono::duration<double, std::milli>(_Clock_t::now() - start).count();
+}
+
+static std::uint32_t pattern(std::uint32_t addr) { return addr * 2654435761u >> 24; }
+
+// A 32-bit ELF file with a text segment of the given size at 0x10000, a data
+// segment which does not start on a page boundary, and a bss after it.
+static void make_elf(const std::string &path, std::uint32_t text) {
+	constexpr std::uint32_t kData = 5000, kBss = 20000;
+	std::vector<unsigned char> file(0x1000 + text + 0x1000 + kData);
+	auto put = [&file](std::size_t at, std::uint32_t value, int bytes) {
+		for (int i = 0; i < bytes; ++i) file[at + i] = static_cast<unsigned char>(value >> (8 * i));
+	};
+	const unsigned char ident[] = {0x7f, 'E', 'L', 'F', 1, 1, 1};
+	std::copy(std::begin(ident), std::end(ident), file.begin());
+	put(16, 2, 2);         // ET_EXEC
+	put(18, 243, 2);       // EM_RISCV
+	put(24, 0x10000, 4);   // Entry
+	put(28, 52, 4);        // Program headers
+	put(42, 32, 2);
+	put(44, 2, 2);
+	const std::uint32_t data_offset = 0x1000 + text + 0x123, data_addr = 0x10000 + text + 0x1123;
+	const std::uint32_t segments[2][4] = {{0x1000, 0x10000, text, text}, {data_offset, data_addr, kData, kData + kBss}};
+	for (int i = 0; i < 2; ++i) {
+		const auto at = 52 + 32 * i;
+		put(at, 1, 4); // PT_LOAD
+		put(at + 4, segments[i][0], 4);
+		put(at + 8, segments[i][1], 4);
+		put(at + 12, segments[i][1], 4);
+		put(at + 16, segments[i][2], 4);
+		put(at + 20, segments[i][3], 4);
+	}
+	for (std::uint32_t i = 0; i < text; ++i) file[0x1000 + i] = pattern(0x10000 + i);
+	for (std::uint32_t i = 0; i < kData; ++i) file[data_offset + i] = pattern(data_addr + i);
+	auto *out = std::fopen(path.c_str(), "wb");
+	std::fwrite(file.data(), 1, file.size(), out);
+	std::fclose(out);
+}
+
+// A hex image of the given size at 0x80000000, 16 bytes per line.
+static void make_hex(const std::string &path, std::uint32_t size) {
+	std::string text = "// test image\n@80000000\n";
+	char byte[4];
+	for (std::uint32_t i = 0; i < size; ++i) {
+		std::snprintf(byte, sizeof(byte), "%02X", pattern(0x80000000u + i));
+		text += byte;
+		text += i % 16 == 15 ? '\n' : ' ';
+	}
+	auto *out = std::fopen(path.c_str(), "wb");
+	std::fwrite(text.data(), 1, text.size(), out);
+	std::fclose(out);
+}
+
+struct Tester_Input {
+	Wire <1> busy;
+	Wire <1> done;
+	Wire <32> rdata;
+};
+
+struct Tester_Output {
+	Register <1> valid;
+	Register <1> write;
+	Register <2> size;
+	Register <32> addr;
+	Register <32> wdata;
+};
+
+struct Tester_Private {
+	Register <32> step;
+	Register <1> waiting;
+	Register <32> errors;
+};
+
+// Writes words through the port, then reads them back and counts the mismatches.
+struct Tester : dark::Module <Tester_Input, Tester_Output, Tester_Private> {
+	static constexpr max_size_t kWords = 256;
+	static max_size_t where(max_size_t i) { return 0x40000ffcu + i * 1028; } // Some cross a page.
+
+	void work() override final {
+		const auto i = to_unsigned(step);
+		if (done && write == 0 && to_unsigned(rdata) != where(i - 1 - kWords) * 7) errors <= errors + 1;
+		const bool issue = (waiting == 0 || done) && i < 2 * kWords && busy == 0;
+		if (issue) {
+			valid <= 1;
+			write <= (i < kWords);
+			size <= 2;
+			addr <= where(i % kWords);
+			wdata <= where(i % kWords) * 7;
+			waiting <= 1;
+			step <= i + 1;
+		} else if (valid) {
+			valid <= 0; // A request is valid for one cycle.
+		}
+	}
+
+	max_size_t steps() const { return to_unsigned(step); }
+	max_size_t mismatches() const { return to_unsigned(errors); }
+};
+
+// Usage: memory [file.elf | file.hex]
+// Loads the given program and prints the load time, or else checks the
+// loaders on generated files and the port against a test module.
+signed main(int argc, char **argv) {
+	if (argc > 1) {
+		const std::string path = argv[1];
+		dark::Memory memory;
+		const auto start = _Clock_t::now();
+		if (path.size() > 4 && path.substr(path.size() - 4) == ".hex") {
+			memory.load_hex(path);
+			std::cout << "loaded in " << since(start) << " ms, " << memory.pages() << " pages\n";
+		} else {
+			const auto entry = memory.load_elf(path);
+			std::cout << "loaded in " << since(start) << " ms, " << memory.pages() << " pages, entry " << std::hex
+					  << entry << '\n';
+		}
+		return 0;
+	}
+
+	bool failed = false;
+	auto check = [&failed](const char *what, bool ok) {
+		if (!ok) failed = true;
+		std::cout << what << ": " << (ok ? "ok" : "FAILED") << '\n';
+	};
+
+	const std::uint32_t text = 64 << 20;
+	const std::string elf = "memory_demo.elf", hex = "memory_demo.hex";
+	make_elf(elf, text);
+	{
+		dark::Memory memory;
+		auto start = _Clock_t::now();
+		const auto entry = memory.load_elf(elf);
+		std::cout << "elf: " << (text >> 20) << " MiB in " << since(start) << " ms, " << memory.pages() << " pages\n";
+		bool ok = entry == 0x10000;
+		for (std::uint32_t addr = 0x10000; addr < 0x10000 + text; addr += 4093)
+			ok = ok && memory.load<std::uint8_t>(addr) == pattern(addr);
+		const std::uint32_t data = 0x10000 + text + 0x1123;
+		for (std::uint32_t addr = data; addr < data + 5000; ++addr)
+			ok = ok && memory.load<std::uint8_t>(addr) == pattern(addr);
+		for (std::uint32_t addr = data + 5000; addr < data + 25000; ++addr)
+			ok = ok && memory.load<std::uint8_t>(addr) == 0;
+		check("elf contents", ok);
+
+		// The first write to a loaded page copies it: the file is not changed.
+		memory.store<std::uint32_t>(0x10000, 0xdeadbeef);
+		dark::Memory again;
+		again.load_elf(elf);
+		check("copy on write", memory.load<std::uint32_t>(0x10000) == 0xdeadbeef &&
+									   again.load<std::uint8_t>(0x10000) == pattern(0x10000));
+	}
+	{
+		// A second segment past the end of the file: nothing is loaded.
+		auto *out = std::fopen(elf.c_str(), "r+b");
+		const unsigned char offset[] = {0xff, 0xff, 0xff, 0x7f};
+		std::fseek(out, 52 + 32 + 4, SEEK_SET);
+		std::fwrite(offset, 1, sizeof(offset), out);
+		std::fclose(out);
+		dark::Memory memory;
+		bool thrown = false;
+		try {
+			memory.load_elf(elf);
+		} catch (const std::runtime_error &) {
+			thrown = true;
+		}
+		check("bad elf", thrown && memory.pages() == 0 && memory.load<std::uint32_t>(0x10000) == 0);
+	}
+	std::remove(elf.c_str());
+
+	const std::uint32_t image = 4 << 20;
+	make_hex(hex, image);
+	{
+		dark::Memory memory;
+		auto start = _Clock_t::now();
+		memory.load_hex(hex);
+		std::cout << "hex: " << (image >> 20) << " MiB in " << since(start) << " ms, " << memory.pages() << " pages\n";
+		bool ok = true;
+		for (std::uint32_t i = 0; i < image; i += 7) ok = ok && memory.load<std::uint8_t>(0x80000000u + i) == pattern(0x80000000u + i);
+		check("hex contents", ok && memory.load<std::uint8_t>(0x80000000u + image) == 0);
+	}
+	std::remove(hex.c_str());
+
+	for (std::uint32_t latency: {1u, 3u}) {
+		dark::Memory memory;
+		dark::MemoryPort port;
+		port.memory  = &memory;
+		port.latency = latency;
+		Tester tester;
+		port.valid = tester.valid;
+		port.write = tester.write;
+		port.size  = tester.size;
+		port.addr  = tester.addr;
+		port.wdata = tester.wdata;
+		tester.busy  = port.busy;
+		tester.done  = port.done;
+		tester.rdata = port.rdata;
+
+		dark::CPU cpu;
+		cpu.add_module(&tester);
+		cpu.add_module(&port);
+		cpu.enable_clock_gating();
+		while (tester.steps() < 2 * Tester::kWords) cpu.run_once_shuffle();
+		cpu.run(latency + 2, true);
+		std::cout << "port, latency " << latency << ": " << cpu.cycles << " cycles, " << memory.pages() << " pages\n";
+		check("port", tester.mismatches() == 0);
+	}
+	{
+		// The latency does not fit the 8-bit count of the port.
+		dark::Memory memory;
+		dark::MemoryPort port;
+		port.memory  = &memory;
+		port.latency = 300;
+		Tester tester;
+		port.valid = tester.valid;
+		port.write = tester.write;
+		port.size  = tester.size;
+		port.addr  = tester.addr;
+		port.wdata = tester.wdata;
+		tester.busy  = port.busy;
+		tester.done  = port.done;
+		tester.rdata = port.rdata;
+		dark::CPU cpu;
+		cpu.add_module(&tester);
+		cpu.add_module(&port);
+		bool thrown = false;
+		try {
+			cpu.run(4);
+		} catch (const std::out_of_range &) {
+			thrown = true;
+		}
+		check("port latency", thrown);
+	}
+	return failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "tools.h"
+#include <cstdlib>
 #include <iostream>
 
 struct RegFile_Input {
@@ -69,7 +70,11 @@ struct InsDecode : dark::Module <InsDecode_Input, InsDecode_Output> {
 	}
 };
 
-signed main() {
+// Usage: modules [seed] [trace.vcd]
+// The seed decides the module order of each cycle. Pass the seed
+// printed by a failing run to replay exactly the same orders.
+// With a file name, the waveform is dumped there (open it with GTKWave).
+signed main(int argc, char **argv) {
 	InsDecode ins_decode;
 	RegFile reg_file;
 
@@ -78,14 +83,31 @@ signed main() {
 	cpu.add_module(&ins_decode);
 	cpu.add_module(&reg_file);
 
-	reg_file.rs1_index = [&]() -> auto & { return ins_decode.rs1_index; };
-	reg_file.rs2_index = [&]() -> auto & { return ins_decode.rs2_index; };
-	reg_file.wb_index = [&]() -> auto & { return ins_decode.wb_index; };
-	reg_file.wb_enable = [&]() -> auto & { return ins_decode.wb_enable; };
-	reg_file.wb_data = [&]() -> auto & { return ins_decode.wb_data; };
-
-	ins_decode.rs1_data = [&]() -> auto & { return reg_file.rs1_data; };
-	ins_decode.rs2_data = [&]() -> auto & { return reg_file.rs2_data; };
+	reg_file.rs1_index = ins_decode.rs1_index;
+	reg_file.rs2_index = ins_decode.rs2_index;
+	reg_file.wb_index = ins_decode.wb_index;
+	reg_file.wb_enable = ins_decode.wb_enable;
+	reg_file.wb_data = ins_decode.wb_data;
+
+	ins_decode.rs1_data = reg_file.rs1_data;
+	ins_decode.rs2_data = reg_file.rs2_data;
+
+	if (argc > 1) cpu.set_seed(std::strtoull(argv[1], nullptr, 10));
+	std::cerr << "seed: " << cpu.seed() << std::endl;
+
+	if (argc > 2) {
+		auto &trace = cpu.enable_trace(argv[2]);
+		trace.name(&ins_decode, "ins_decode",
+				   {"rs1_data", "rs2_data", "rs1_index", "rs2_index", "wb_index", "wb_data", "wb_enable"});
+		std::vector<std::string> names = {"rs1_index", "rs2_index", "wb_index", "wb_enable", "wb_data",
+										  "rs1_data", "rs2_data"};
+		for (int i = 0; i < 32; ++i) {
+			std::string name = "x";
+			name += std::to_string(i);
+			names.push_back(std::move(name));
+		}
+		trace.name(&reg_file, "reg_file", names);
+	}
 
 	cpu.run(114514, true);
 
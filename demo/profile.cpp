@@ -0,0 +1,214 @@
+#include "tools.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+constexpr std::size_t kStages = 4;
+
+struct Source_Input {};
+
+struct Source_Output {
+	Register <1> valid;
+	Register <32> value;
+};
+
+struct Source_Private {
+	Register <32> lfsr;
+};
+
+// Sends a random value about every other cycle.
+struct Source : dark::Module <Source_Input, Source_Output, Source_Private> {
+	dark::Counter writes;	// Registers written, to check the profile.
+
+	void work() override final {
+		max_size_t x = to_unsigned(lfsr);
+		x = x == 0 ? 0x2545f491 : x;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		lfsr <= x;
+		++writes;
+		if ((x & 1) != (valid != 0)) {
+			valid <= (x & 1);
+			++writes;
+		}
+		if (x & 1) {
+			value <= x >> 1;
+			++writes;
+		}
+	}
+
+	void counters(dark::CounterList &list) override { list.add("writes", writes); }
+};
+
+struct Stage_Input {
+	Wire <1> valid;
+	Wire <32> value;
+};
+
+struct Stage_Output {
+	Register <1> ready;
+	Register <32> result;
+};
+
+// Takes the values it likes, and stalls on the others.
+struct Stage : dark::Module <Stage_Input, Stage_Output> {
+	max_size_t id = 0;
+	dark::Counter accepted, stalls, writes, reads;
+
+	void work() override final {
+		bool take = false;
+		++reads;
+		if (valid) {
+			++reads;
+			take = to_unsigned(value) % kStages != id;
+			if (!take) ++stalls;
+		}
+		if (take) {
+			result <= result + value;
+			++accepted;
+			++writes;
+		}
+		if (take != (ready != 0)) {
+			ready <= take;
+			++writes;
+		}
+	}
+
+	void counters(dark::CounterList &list) override {
+		list.add("accepted", accepted);
+		list.add("stalls", stalls);
+		list.add("writes", writes);
+		list.add("reads", reads);
+	}
+};
+
+struct Sink_Input {
+	std::array <Wire <1>, kStages> ready;
+	std::array <Wire <32>, kStages> result;
+};
+
+struct Sink_Output {
+	Register <32> total;
+};
+
+struct Sink : dark::Module <Sink_Input, Sink_Output> {
+	dark::Counter writes, reads;
+
+	void work() override final {
+		max_size_t sum = 0;
+		for (std::size_t i = 0; i < kStages; ++i) {
+			++reads;
+			if (ready[i]) {
+				++reads;
+				sum += to_unsigned(result[i]);
+			}
+		}
+		if (sum != 0) {
+			total <= total + sum;
+			++writes;
+		}
+	}
+
+	void counters(dark::CounterList &list) override {
+		list.add("writes", writes);
+		list.add("reads", reads);
+	}
+};
+
+struct System {
+	Source source;
+	std::array <Stage, kStages> stages;
+	Sink sink;
+	dark::CPU cpu;
+
+	System() {
+		cpu.add_module(&source);
+		for (std::size_t i = 0; i < kStages; ++i) {
+			auto &stage = stages[i];
+			stage.id = i;
+			// Functions, so that the wires are evaluated (aliases read the register).
+			stage.valid = [this]() { return to_unsigned(source.valid); };
+			stage.value = [this, i]() { return to_unsigned(source.value) ^ i; };
+			sink.ready[i] = [&stage]() { return to_unsigned(stage.ready); };
+			sink.result[i] = [&stage]() { return to_unsigned(stage.result); };
+			cpu.add_module(&stage);
+		}
+		cpu.add_module(&sink);
+	}
+
+	// Whether the counts of the profile match the ones the modules keep.
+	bool check(const dark::Profile &profile, bool topo) const {
+		bool ok = profile.entry(0).events.register_writes == source.writes.value;
+		for (std::size_t i = 0; i < kStages; ++i) {
+			const auto &events = profile.entry(1 + i).events;
+			ok = ok && events.register_writes == stages[i].writes.value;
+			ok = ok && events.wire_evaluations == (topo ? 0 : stages[i].reads.value);
+		}
+		const auto &events = profile.entry(1 + kStages).events;
+		ok = ok && events.register_writes == sink.writes.value;
+		ok = ok && events.wire_evaluations == (topo ? 0 : sink.reads.value);
+		return ok;
+	}
+};
+
+// Usage: profile [cycles]
+// Profiles a small pipeline in several modes, checks the register writes
+// and wire evaluations against the counts kept by the modules, and writes
+// profile.json and profile.csv. Then times the design with and without it.
+signed main(int argc, char **argv) {
+	using _Clock_t = std::chrono::steady_clock;
+	const unsigned long long cycles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+	struct Mode {
+		const char *name;
+		bool dirty;
+		bool topo;
+		std::size_t threads;
+	};
+	const Mode modes[] = {
+			{"serial", false, false, 1},
+			{"dirty", true, false, 1},
+			{"topo", false, true, 1},
+			{"threads", false, false, 2},
+	};
+
+	bool failed = false;
+	for (auto &mode: modes) {
+		auto system = std::make_unique<System>();
+		auto &cpu   = system->cpu;
+		cpu.enable_dirty_sync(mode.dirty);
+		cpu.enable_topo_eval(mode.topo);
+		cpu.set_threads(mode.threads);
+		auto &profile = cpu.enable_profiling("profile.json", dark::ProfileFormat::Json, 16);
+		profile.name(&system->source, "source");
+		profile.name(&system->sink, "sink");
+		cpu.run(cycles);
+		const bool ok = system->check(profile, mode.topo);
+		failed = failed || !ok;
+		std::cout << mode.name << ": " << (ok ? "ok" : "MISMATCH") << ", "
+				  << profile.outside().wire_evaluations << " wires evaluated before work()\n";
+	}
+
+	{
+		auto system = std::make_unique<System>();
+		auto &profile = system->cpu.enable_profiling("profile.csv", dark::ProfileFormat::Csv);
+		for (std::size_t i = 0; i < kStages; ++i) profile.name(&system->stages[i], "stage" + std::to_string(i));
+		profile.name(&system->sink, "sink \"total\", all stages"); // Quoted in the file.
+		system->cpu.run(cycles);
+		std::cout << "profile.csv:\n" << std::ifstream("profile.csv").rdbuf();
+	}
+	std::cout << "profile.json:\n" << std::ifstream("profile.json").rdbuf();
+
+	for (bool profiling: {false, true}) {
+		auto system = std::make_unique<System>();
+		if (profiling) system->cpu.enable_profiling("profile.json");
+		auto start = _Clock_t::now();
+		system->cpu.run(cycles * 10);
+		std::chrono::duration<double> elapsed = _Clock_t::now() - start;
+		std::cout << (profiling ? "profiled" : "plain") << ": " << cycles * 10 / elapsed.count() << " cycles/s\n";
+	}
+	return failed ? 1 : 0;
+}
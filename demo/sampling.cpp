@@ -0,0 +1,99 @@
+#include "tools.h"
+#include "sampling.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+// A toy core: each instruction stalls for a latency which depends on the
+// phase of the program, so the IPC changes over time.
+struct Core : dark::ModuleBase {
+	// Architectural state, advanced by both models.
+	std::uint64_t pc   = 0;
+	std::uint32_t lfsr = 0xace1;
+
+	// Timing state of the cycle model.
+	Register<8> stall;
+	Register<32> retired;
+
+	unsigned latency() const {
+		static constexpr unsigned mask[4] = {0x0, 0x3, 0x7, 0x1f};
+		return lfsr & mask[(pc >> 18) & 3];
+	}
+
+	// The functional model: execute one instruction, without timing.
+	void step() {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xd0000001u);
+		++pc;
+	}
+
+	void work() override {
+		if (stall != 0) {
+			stall <= stall - 1;
+			return;
+		}
+		stall <= latency();
+		step();
+		retired <= retired + 1;
+	}
+	void sync() override {
+		Visitor::sync(stall);
+		Visitor::sync(retired);
+	}
+	void probe(dark::ProbeList &list) override {
+		list.push_back(dark::Probe::make(stall));
+		list.push_back(dark::Probe::make(retired));
+	}
+	void checkpoint(dark::Archive &ar) override {
+		ar.value(pc);
+		ar.value(lfsr);
+	}
+};
+
+// Usage: sampling [samples] [interval]
+// Estimates the IPC of the toy core over samples * interval instructions:
+// the functional model fast-forwards between sample points, and each point
+// runs a window of the cycle model in a child process. Then the whole
+// program is simulated cycle by cycle, to compare.
+signed main(int argc, char **argv) {
+	using _Clock_t = std::chrono::steady_clock;
+	constexpr unsigned long long kWarm   = 2000;  // Cycles to warm the timing state.
+	constexpr unsigned long long kWindow = 10000; // Cycles measured per sample.
+
+	dark::SamplingOptions options;
+	options.samples  = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+	options.interval = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1 << 18;
+	const auto total = options.samples * options.interval;
+
+	Core core;
+	dark::CPU cpu;
+	cpu.add_module(&core);
+
+	auto start  = _Clock_t::now();
+	auto result = dark::sample(
+			options,
+			[&](std::uint64_t instructions) {
+				while (instructions-- != 0) core.step();
+			},
+			[&]() {
+				cpu.run(cpu.cycles + kWarm);
+				const auto before = to_unsigned(core.retired);
+				cpu.run(cpu.cycles + kWindow);
+				// CPI, not IPC: sample points are spread over instructions, so CPI is what averages.
+				return std::vector<double>{static_cast<double>(kWindow) / (to_unsigned(core.retired) - before)};
+			});
+	std::chrono::duration<double> sampled = _Clock_t::now() - start;
+	auto cpi = result.summary(0);
+	std::cout << "sampled: IPC " << 1 / cpi.mean << " +- " << cpi.error / (cpi.mean * cpi.mean) << " ("
+			  << cpi.count << " samples, " << result.failed << " failed) in " << sampled.count() << " s\n";
+
+	Core full_core;
+	dark::CPU full;
+	full.add_module(&full_core);
+	start = _Clock_t::now();
+	while (full_core.pc < total) full.run_once();
+	std::chrono::duration<double> detailed = _Clock_t::now() - start;
+	std::cout << "detailed: IPC " << static_cast<double>(full_core.pc) / static_cast<double>(full.cycles) << " in "
+			  << detailed.count() << " s\n";
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "tools.h"
+#include <bitset>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// A bit-by-bit model of the wide operators, on std::bitset.
+template<std::size_t _Len>
+using Model = std::bitset<_Len>;
+
+template<std::size_t _Len>
+Model<_Len> model(const Bit<_Len> &value) {
+	Model<_Len> bits;
+	for (std::size_t i = 0; i < _Len; ++i) bits[i] = (value.word(i / 64) >> (i % 64)) & 1;
+	return bits;
+}
+
+template<std::size_t _Len>
+Model<_Len> add(const Model<_Len> &a, const Model<_Len> &b, bool carry) {
+	Model<_Len> sum;
+	for (std::size_t i = 0; i < _Len; ++i) {
+		sum[i] = a[i] ^ b[i] ^ carry;
+		carry  = (a[i] && b[i]) || (carry && (a[i] || b[i]));
+	}
+	return sum;
+}
+
+template<std::size_t _Len>
+bool less(const Model<_Len> &a, const Model<_Len> &b) {
+	for (std::size_t i = _Len; i-- > 0;)
+		if (a[i] != b[i]) return b[i];
+	return false;
+}
+
+template<std::size_t _Len>
+Bit<_Len> random_value(std::mt19937_64 &engine) {
+	typename Bit<_Len>::_Array_t words;
+	for (auto &word: words) word = engine();
+	switch (engine() % 6) { // Values which carry, borrow or sign extend.
+		case 0: words.fill(~0ull); break;
+		case 1: words.fill(0); words[0] = ~0ull; break;
+		case 2: words.fill(0); words[0] = 1; break;
+		case 3: words.fill(0); words.back() = ~0ull; break;
+		default: break;
+	}
+	return Bit<_Len>(words);
+}
+
+struct Checker {
+	std::size_t failures = 0;
+
+	template<std::size_t _Len>
+	void expect(const char *what, std::size_t width, const Bit<_Len> &actual, const Model<_Len> &expected) {
+		if (model(actual) == expected) return;
+		if (++failures <= 10) std::cout << what << " differs at " << width << " bits\n";
+	}
+	void expect(const char *what, std::size_t width, bool actual, bool expected) {
+		if (actual == expected) return;
+		if (++failures <= 10) std::cout << what << " differs at " << width << " bits\n";
+	}
+};
+
+template<std::size_t _Len>
+void check_width(std::mt19937_64 &engine, Checker &check) {
+	for (int round = 0; round < 300; ++round) {
+		const auto a = random_value<_Len>(engine);
+		const auto b = random_value<_Len>(engine);
+		const auto x = model(a), y = model(b);
+
+		check.expect("a + b", _Len, Bit<_Len>(a + b), add(x, y, false));
+		check.expect("a - b", _Len, Bit<_Len>(a - b), add(x, ~y, true));
+		check.expect("-a", _Len, Bit<_Len>(-a), add(Model<_Len>(), ~x, true));
+		check.expect("a & b", _Len, Bit<_Len>(a & b), x & y);
+		check.expect("a | b", _Len, Bit<_Len>(a | b), x | y);
+		check.expect("a ^ b", _Len, Bit<_Len>(a ^ b), x ^ y);
+		check.expect("~a", _Len, Bit<_Len>(~a), ~x);
+		check.expect("a == b", _Len, a == b, x == y);
+		check.expect("a == a", _Len, a == a, true);
+		check.expect("a < b", _Len, a < b, less(x, y));
+		check.expect("a > b", _Len, a > b, less(y, x));
+
+		// Within a word, across words, at the width and beyond it.
+		for (std::size_t shift: {std::size_t{0}, std::size_t{1}, std::size_t{37}, std::size_t{63}, std::size_t{64},
+								 std::size_t{65}, std::size_t{127}, std::size_t{128}, _Len - 1, _Len, _Len + 1,
+								 std::size_t{1000}, static_cast<std::size_t>(engine() % (_Len + 8))}) {
+			const auto expected_left  = shift >= _Len ? Model<_Len>() : x << shift;
+			const auto expected_right = shift >= _Len ? Model<_Len>() : x >> shift;
+			check.expect("a << n", _Len, Bit<_Len>(a << shift), expected_left);
+			check.expect("a >> n", _Len, Bit<_Len>(a >> shift), expected_right);
+		}
+
+		// Widths which are not multiples of 64.
+		constexpr std::size_t _Wider = _Len + 37;
+		Model<_Wider> extended;
+		for (std::size_t i = 0; i < _Wider; ++i) extended[i] = i < _Len ? x[i] : x[_Len - 1];
+		check.expect("sign_extend", _Wider, sign_extend<_Wider>(a), extended);
+		for (std::size_t i = _Len; i < _Wider; ++i) extended[i] = false;
+		check.expect("zero_extend", _Wider, zero_extend<_Wider>(a), extended);
+
+		const auto high = Bit<13>(static_cast<max_size_t>(engine()));
+		Model<_Len + 13> joined;
+		for (std::size_t i = 0; i < _Len + 13; ++i)
+			joined[i] = i < _Len ? x[i] : ((to_unsigned(high) >> (i - _Len)) & 1) != 0;
+		check.expect("{Bit<13>, a}", _Len + 13, Bit<_Len + 13>(high, a), joined);
+
+		Model<2 * _Len> pair;
+		for (std::size_t i = 0; i < 2 * _Len; ++i) pair[i] = i < _Len ? y[i] : x[i - _Len];
+		check.expect("{a, b}", 2 * _Len, Bit<2 * _Len>(a, b), pair);
+
+		Model<_Len - 3> ranged;
+		for (std::size_t i = 0; i < _Len - 3; ++i) ranged[i] = x[i + 3];
+		check.expect("a.range", _Len - 3, a.template range<_Len - 1, 3>(), ranged);
+		const auto pos = static_cast<std::size_t>(engine() % (_Len - 64));
+		Model<65> sliced;
+		for (std::size_t i = 0; i < 65; ++i) sliced[i] = x[i + pos];
+		check.expect("a.slice", 65, a.template slice<65>(pos), sliced);
+	}
+}
+
+// Usage: wide [seed]
+// Checks the wide Bit operators against a bit-by-bit model, at widths
+// around word boundaries: carries and borrows across words, shifts by
+// 64 or more and by the width or more, extension and concatenation.
+signed main(int argc, char **argv) {
+	std::mt19937_64 engine(argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1);
+	Checker check;
+	check_width<65>(engine, check);
+	check_width<100>(engine, check);
+	check_width<127>(engine, check);
+	check_width<128>(engine, check);
+	check_width<129>(engine, check);
+	check_width<200>(engine, check);
+	check_width<257>(engine, check);
+	check_width<511>(engine, check);
+	std::cout << "wide operators: " << (check.failures == 0 ? "ok" : "FAILED") << " (" << check.failures
+			  << " failures)\n";
+	return check.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace dark {
+
+/**
+ * @brief Saves or restores the state of a module that its registers do not
+ * hold, such as plain members of a custom module, in a checkpoint.
+ * The same function describes both directions, so they cannot disagree:
+ *
+ *     void checkpoint(dark::Archive &ar) override { ar.value(pc); ar.vector(memory); }
+ *
+ * Blocks of at least kPageSize bytes start at a page boundary of the file,
+ * so a checkpoint can be mapped and large memories copied page by page.
+ */
+class Archive {
+public:
+	static constexpr std::size_t kPageSize = 4096;
+
+private:
+	std::vector<std::byte> *_M_out; // Saving: the whole file.
+	const std::byte *_M_base;       // Loading: the whole file.
+	std::size_t _M_pos;
+	std::size_t _M_end;
+
+	static std::size_t _M_alignment(std::size_t size) { return size >= kPageSize ? kPageSize : alignof(std::max_align_t); }
+
+public:
+	explicit Archive(std::vector<std::byte> &out) : _M_out(&out), _M_base(), _M_pos(), _M_end() {}
+
+	/* Load from bytes [begin, end) of a file mapped at base. */
+	Archive(const std::byte *base, std::size_t begin, std::size_t end)
+		: _M_out(), _M_base(base), _M_pos(begin), _M_end(end) {}
+
+	bool saving() const { return this->_M_out != nullptr; }
+
+	void bytes(void *data, std::size_t size) {
+		if (size == 0) return;
+		const auto align = _M_alignment(size);
+		if (this->saving()) {
+			auto &out = *this->_M_out;
+			out.resize((out.size() + align - 1) / align * align);
+			const auto *ptr = static_cast<const std::byte *>(data);
+			out.insert(out.end(), ptr, ptr + size);
+			return;
+		}
+		const auto pos = (this->_M_pos + align - 1) / align * align;
+		if (pos > this->_M_end || size > this->_M_end - pos)
+			throw std::runtime_error("Checkpoint: module state is shorter than expected.");
+		std::memcpy(data, this->_M_base + pos, size);
+		this->_M_pos = pos + size;
+	}
+
+	template<typename _Tp>
+		requires std::is_trivially_copyable_v<_Tp>
+	void value(_Tp &value) {
+		this->bytes(&value, sizeof(_Tp));
+	}
+
+	/* Size, then the elements. Loading resizes the vector. */
+	template<typename _Tp>
+		requires std::is_trivially_copyable_v<_Tp>
+	void vector(std::vector<_Tp> &values) {
+		std::size_t size = values.size();
+		this->value(size);
+		if (!this->saving()) {
+			if (size > (this->_M_end - this->_M_pos) / sizeof(_Tp))
+				throw std::runtime_error("Checkpoint: module state is shorter than expected.");
+			values.resize(size);
+		}
+		this->bytes(values.data(), size * sizeof(_Tp));
+	}
+};
+
+} // namespace dark
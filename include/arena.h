@@ -0,0 +1,55 @@
+#pragma once
+#include "concept.h"
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace dark::details {
+
+/* Number of registers in one page of the register arena. */
+inline constexpr std::size_t kArenaPageSize = 1024;
+
+/**
+ * @brief Contiguous double-buffered storage for registers.
+ * Each page holds an old plane followed by a new plane, so the new value
+ * of a slot lives exactly kArenaPageSize words after its old value.
+ * Pages are never moved, so slots stay valid while the arena lives.
+ */
+struct RegisterArena {
+private:
+	struct Page {
+		max_size_t old_plane[kArenaPageSize];
+		max_size_t new_plane[kArenaPageSize];
+	};
+
+	std::vector<std::unique_ptr<Page>> _M_pages;
+	std::size_t _M_used = kArenaPageSize; // Slots used in the last page.
+
+public:
+	/* Return the old-plane slot of a new register. */
+	max_size_t *allocate() {
+		if (this->_M_used == kArenaPageSize) {
+			this->_M_pages.push_back(std::make_unique<Page>());
+			this->_M_used = 0;
+		}
+		return &this->_M_pages.back()->old_plane[this->_M_used++];
+	}
+
+	/* Commit all registers: the new plane becomes the old plane. */
+	void commit() {
+		if (this->_M_pages.empty()) return;
+		const auto last = this->_M_pages.size() - 1;
+		for (std::size_t i = 0; i < last; ++i) {
+			auto &page = *this->_M_pages[i];
+			std::memcpy(page.old_plane, page.new_plane, sizeof(page.new_plane));
+		}
+		auto &page = *this->_M_pages[last];
+		std::memcpy(page.old_plane, page.new_plane, this->_M_used * sizeof(max_size_t));
+	}
+
+	std::size_t size() const {
+		return this->_M_pages.empty() ? 0 : (this->_M_pages.size() - 1) * kArenaPageSize + this->_M_used;
+	}
+};
+
+} // namespace dark::details
@@ -0,0 +1,375 @@
+#pragma once
+#include "archive.h"
+#include "memory.h"
+#include "module.h"
+#include "simd.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace dark {
+
+/* A level of the memory hierarchy below a cache. Accesses are functional, and return the cycles they take. */
+struct MemoryLevel {
+	virtual std::uint32_t read(std::uint32_t addr, void *data, std::uint32_t size)        = 0;
+	virtual std::uint32_t write(std::uint32_t addr, const void *data, std::uint32_t size) = 0;
+	virtual ~MemoryLevel() = default;
+};
+
+/* A Memory as the last level, with a fixed latency. */
+class MainMemory : public MemoryLevel {
+private:
+	Memory &_M_memory;
+	std::uint32_t _M_latency;
+
+public:
+	explicit MainMemory(Memory &memory, std::uint32_t latency = 100) : _M_memory(memory), _M_latency(latency) {}
+
+	std::uint32_t read(std::uint32_t addr, void *data, std::uint32_t size) override {
+		this->_M_memory.read(addr, data, size);
+		return this->_M_latency;
+	}
+	std::uint32_t write(std::uint32_t addr, const void *data, std::uint32_t size) override {
+		this->_M_memory.write(addr, data, size);
+		return this->_M_latency;
+	}
+};
+
+enum class CacheReplacement : std::uint8_t { Lru, Fifo, Random };
+
+struct CacheConfig {
+	std::uint32_t size = 32 << 10; // Bytes of data.
+	std::uint32_t ways = 8;
+	std::uint32_t line = 64;       // Bytes per line.
+	CacheReplacement replacement = CacheReplacement::Lru;
+	bool write_back = true;        // Else write-through, with no allocation on a write miss.
+	std::uint32_t hit_latency = 1;
+	std::uint32_t mshrs = 4;       // Lines in flight in a CachePort.
+};
+
+struct CacheStats {
+	std::uint64_t reads        = 0;
+	std::uint64_t writes       = 0;
+	std::uint64_t read_misses  = 0;
+	std::uint64_t write_misses = 0;
+	std::uint64_t evictions    = 0; // Valid lines replaced.
+	std::uint64_t writebacks   = 0; // Dirty lines written to the next level.
+	std::uint64_t merged       = 0; // CachePort: requests to a line in flight.
+	std::uint64_t stalls       = 0; // CachePort: cycles not ready for a request.
+
+	std::uint64_t hits() const { return this->reads + this->writes - this->read_misses - this->write_misses; }
+	std::uint64_t misses() const { return this->read_misses + this->write_misses; }
+};
+
+/**
+ * @brief The arrays of a set-associative cache, with functional accesses
+ * which return their latency, so that it also serves as the level below
+ * another cache. The tags of a set are contiguous, padded to a multiple of
+ * 4 lanes, and compared with the key at once by SIMD instructions.
+ */
+class Cache : public MemoryLevel {
+public:
+	/* The tag of an empty way. Tags are line numbers, which never reach it. */
+	static constexpr std::uint32_t kInvalid = ~0u;
+
+	struct Access {
+		bool hit;
+		std::uint32_t latency;
+	};
+
+private:
+	CacheConfig _M_config;
+	MemoryLevel *_M_next;
+	std::uint32_t _M_line_bits;
+	std::uint32_t _M_set_mask;
+	std::uint32_t _M_stride;              // Lanes of tags per set.
+	std::vector<std::uint32_t> _M_tags;   // _M_stride per set: the ways, then padding.
+	std::vector<std::uint64_t> _M_stamps; // Per way: last use (LRU) or fill (FIFO).
+	std::vector<std::uint8_t> _M_dirty;
+	std::vector<std::byte> _M_data;
+	std::uint64_t _M_clock  = 0;
+	std::uint64_t _M_random = 0x9e3779b97f4a7c15;
+	CacheStats _M_stats;
+
+	static bool _M_power_of_two(std::uint32_t value) { return value != 0 && (value & (value - 1)) == 0; }
+
+	std::size_t _M_slot(std::uint32_t set, std::size_t way) const { return std::size_t{set} * this->_M_config.ways + way; }
+	std::byte *_M_line(std::size_t slot) { return this->_M_data.data() + slot * this->_M_config.line; }
+
+	std::size_t _M_find(std::uint32_t number) const {
+		const auto set = number & this->_M_set_mask;
+		const auto way = details::find_lane(this->_M_tags.data() + std::size_t{set} * this->_M_stride, this->_M_stride, number);
+		return way < this->_M_config.ways ? way : this->_M_config.ways;
+	}
+
+	std::size_t _M_victim(std::uint32_t set) {
+		const auto *tags = this->_M_tags.data() + std::size_t{set} * this->_M_stride;
+		const auto empty = details::find_lane(tags, this->_M_stride, kInvalid);
+		if (empty < this->_M_config.ways) return empty;
+		if (this->_M_config.replacement == CacheReplacement::Random) {
+			auto &x = this->_M_random;
+			x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+			return x % this->_M_config.ways;
+		}
+		const auto *stamps = this->_M_stamps.data() + this->_M_slot(set, 0);
+		return std::min_element(stamps, stamps + this->_M_config.ways) - stamps;
+	}
+
+	/* Bring a line into the cache. Return its way, and add the cycles of the transfers to latency. */
+	std::size_t _M_fill(std::uint32_t number, std::uint32_t &latency) {
+		const auto set  = number & this->_M_set_mask;
+		const auto way  = this->_M_victim(set);
+		const auto slot = this->_M_slot(set, way);
+		auto &tag       = this->_M_tags[std::size_t{set} * this->_M_stride + way];
+		auto *line      = this->_M_line(slot);
+		if (tag != kInvalid) {
+			++this->_M_stats.evictions;
+			if (this->_M_dirty[slot] != 0) {
+				++this->_M_stats.writebacks;
+				latency += this->_M_next->write(tag << this->_M_line_bits, line, this->_M_config.line);
+			}
+		}
+		latency += this->_M_next->read(number << this->_M_line_bits, line, this->_M_config.line);
+		tag                  = number;
+		this->_M_dirty[slot] = 0;
+		this->_M_stamps[slot] = ++this->_M_clock;
+		return way;
+	}
+
+	/* An access within a line: out receives the data read, or in holds the data written. */
+	Access _M_access(std::uint32_t addr, std::byte *out, const std::byte *in, std::uint32_t size) {
+		const auto number = addr >> this->_M_line_bits;
+		const auto set    = number & this->_M_set_mask;
+		const auto offset = addr & (this->_M_config.line - 1);
+		const bool write  = in != nullptr;
+		Access result{true, this->_M_config.hit_latency};
+		++(write ? this->_M_stats.writes : this->_M_stats.reads);
+
+		auto way = this->_M_find(number);
+		if (way == this->_M_config.ways) {
+			result.hit = false;
+			++(write ? this->_M_stats.write_misses : this->_M_stats.read_misses);
+			if (write && !this->_M_config.write_back) {
+				this->_M_next->write(addr, in, size); // Posted: the writer does not wait.
+				return result;
+			}
+			way = this->_M_fill(number, result.latency);
+		}
+
+		const auto slot = this->_M_slot(set, way);
+		if (this->_M_config.replacement == CacheReplacement::Lru) this->_M_stamps[slot] = ++this->_M_clock;
+		auto *line = this->_M_line(slot) + offset;
+		if (!write) {
+			std::memcpy(out, line, size);
+		} else {
+			std::memcpy(line, in, size);
+			if (this->_M_config.write_back) this->_M_dirty[slot] = 1;
+			else this->_M_next->write(addr, in, size);
+		}
+		return result;
+	}
+
+	/* Split an access at line boundaries. It hits if all its lines hit, and takes the longest latency. */
+	Access _M_split(std::uint32_t addr, std::byte *out, const std::byte *in, std::uint32_t size) {
+		Access result{true, 0};
+		while (size != 0) {
+			const auto count = std::min(size, this->_M_config.line - (addr & (this->_M_config.line - 1)));
+			const auto part  = this->_M_access(addr, out, in, count);
+			result.hit       = result.hit && part.hit;
+			result.latency   = std::max(result.latency, part.latency);
+			addr += count, size -= count;
+			if (out != nullptr) out += count;
+			if (in != nullptr) in += count;
+		}
+		return result;
+	}
+
+public:
+	/* @throw std::invalid_argument if the geometry is not made of powers of two. */
+	Cache(const CacheConfig &config, MemoryLevel &next) : _M_config(config), _M_next(&next) {
+		const auto &c = config;
+		if (!_M_power_of_two(c.line) || c.line < 4 || c.ways == 0 || c.size % (c.ways * c.line) != 0 ||
+			!_M_power_of_two(c.size / (c.ways * c.line)) || c.mshrs == 0 || c.hit_latency == 0)
+			throw std::invalid_argument("Cache: bad configuration");
+		const auto sets     = c.size / (c.ways * c.line);
+		this->_M_line_bits  = static_cast<std::uint32_t>(std::countr_zero(c.line));
+		this->_M_set_mask   = sets - 1;
+		this->_M_stride     = (c.ways + 3) & ~3u;
+		this->_M_tags.assign(std::size_t{sets} * this->_M_stride, kInvalid);
+		this->_M_stamps.assign(std::size_t{sets} * c.ways, 0);
+		this->_M_dirty.assign(std::size_t{sets} * c.ways, 0);
+		this->_M_data.assign(c.size, std::byte{});
+	}
+
+	const CacheConfig &config() const { return this->_M_config; }
+	std::uint32_t sets() const { return this->_M_set_mask + 1; }
+	const CacheStats &stats() const { return this->_M_stats; }
+	CacheStats &stats() { return this->_M_stats; }
+
+	/* Whether the line of addr is present. No side effect. */
+	bool contains(std::uint32_t addr) const { return this->_M_find(addr >> this->_M_line_bits) != this->_M_config.ways; }
+
+	/* A read (data receives size bytes) or a write (data holds them), counted in the stats. */
+	Access access(std::uint32_t addr, void *data, std::uint32_t size, bool write) {
+		return write ? this->_M_split(addr, nullptr, static_cast<const std::byte *>(data), size)
+					 : this->_M_split(addr, static_cast<std::byte *>(data), nullptr, size);
+	}
+
+	std::uint32_t read(std::uint32_t addr, void *data, std::uint32_t size) override {
+		return this->_M_split(addr, static_cast<std::byte *>(data), nullptr, size).latency;
+	}
+	std::uint32_t write(std::uint32_t addr, const void *data, std::uint32_t size) override {
+		return this->_M_split(addr, nullptr, static_cast<const std::byte *>(data), size).latency;
+	}
+
+	/* Write all dirty lines to the next level. Return the cycles it takes. */
+	std::uint32_t flush() {
+		std::uint32_t latency = 0;
+		for (std::uint32_t set = 0; set < this->sets(); ++set) {
+			for (std::size_t way = 0; way < this->_M_config.ways; ++way) {
+				const auto slot = this->_M_slot(set, way);
+				if (this->_M_dirty[slot] == 0) continue;
+				const auto tag = this->_M_tags[std::size_t{set} * this->_M_stride + way];
+				latency += this->_M_next->write(tag << this->_M_line_bits, this->_M_line(slot), this->_M_config.line);
+				this->_M_dirty[slot] = 0;
+			}
+		}
+		return latency;
+	}
+
+	/* Drop all lines, dirty or not. */
+	void invalidate() {
+		std::fill(this->_M_tags.begin(), this->_M_tags.end(), kInvalid);
+		std::fill(this->_M_dirty.begin(), this->_M_dirty.end(), 0);
+	}
+
+	/* @throw std::runtime_error if the saved cache has another geometry. */
+	void checkpoint(Archive &ar) {
+		const auto tags = this->_M_tags.size(), data = this->_M_data.size();
+		ar.vector(this->_M_tags);
+		ar.vector(this->_M_stamps);
+		ar.vector(this->_M_dirty);
+		ar.vector(this->_M_data);
+		ar.value(this->_M_clock);
+		ar.value(this->_M_random);
+		ar.value(this->_M_stats);
+		if (this->_M_tags.size() != tags || this->_M_data.size() != data || this->_M_dirty.size() != this->_M_stamps.size())
+			throw std::runtime_error("Checkpoint: the cache has another geometry.");
+	}
+};
+
+/* The request side of a cache port: a request is taken in a cycle where both valid and ready are high. */
+struct CacheRequest {
+	Wire<1> valid;
+	Wire<1> write;
+	Wire<2> size; // log2 of the bytes: 0, 1 or 2 (3 is taken as 2).
+	Wire<32> addr;
+	Wire<32> wdata;
+	Wire<8> id;   // Returned with the response.
+};
+
+struct CacheResponse {
+	Register<1> ready; // A request is taken in this cycle, if valid.
+	Register<1> done;  // The request rid completes in this cycle.
+	Register<8> rid;
+	Register<32> rdata;
+};
+
+/**
+ * @brief A non-blocking cache as a Module. It takes a request per cycle
+ * while it has a free MSHR (miss status holding register), answers a hit
+ * after the hit latency, and a miss when its line arrives; a miss to a line
+ * already in flight waits for that line. Responses come back one per cycle,
+ * in order of completion, with the id of their request.
+ * The arrays are updated when a request is taken; only the response waits.
+ */
+class CachePort : public Module<CacheRequest, CacheResponse> {
+private:
+	struct Miss {
+		std::uint32_t line;
+		std::uint64_t done; // Cycle when the line arrives.
+	};
+	struct Reply {
+		std::uint64_t cycle;
+		std::uint64_t order;
+		std::uint32_t id;
+		std::uint32_t data;
+	};
+
+	/* Responses waiting, beyond which the port stops taking requests. */
+	static constexpr std::size_t kMaxReplies = 64;
+
+	Cache _M_cache;
+	std::vector<Miss> _M_misses;   // In flight, at most config.mshrs.
+	std::vector<Reply> _M_replies; // By cycle, then order.
+	std::uint64_t _M_now   = 0;
+	std::uint64_t _M_order = 0;
+
+	void _M_take() {
+		const auto &config = this->_M_cache.config();
+		const auto where   = static_cast<std::uint32_t>(to_unsigned(addr));
+		const auto number  = where / config.line;
+		const bool store   = write != 0;
+		std::uint32_t data = store ? static_cast<std::uint32_t>(to_unsigned(wdata)) : 0;
+
+		const auto bytes  = to_unsigned(size) < 2 ? 1u << to_unsigned(size) : 4u; // Like MemoryPort: 3 is a word.
+		const auto result = this->_M_cache.access(where, &data, bytes, store);
+		auto cycle        = this->_M_now + result.latency - 1;
+		auto miss = std::find_if(this->_M_misses.begin(), this->_M_misses.end(), [number](const Miss &m) { return m.line == number; });
+		if (miss != this->_M_misses.end()) {
+			++this->_M_cache.stats().merged;
+			cycle = std::max(cycle, miss->done);
+		} else if (!result.hit && !(store && !config.write_back)) {
+			this->_M_misses.push_back({number, cycle});
+		}
+
+		const Reply reply{cycle, this->_M_order++, static_cast<std::uint32_t>(to_unsigned(id)), store ? 0 : data};
+		auto at = std::upper_bound(this->_M_replies.begin(), this->_M_replies.end(), reply, [](const Reply &a, const Reply &b) {
+			return a.cycle != b.cycle ? a.cycle < b.cycle : a.order < b.order;
+		});
+		this->_M_replies.insert(at, reply);
+	}
+
+public:
+	CachePort(const CacheConfig &config, MemoryLevel &next) : _M_cache(config, next) {}
+
+	Cache &cache() { return this->_M_cache; }
+	const CacheStats &stats() const { return this->_M_cache.stats(); }
+
+	void work() override final {
+		++this->_M_now;
+		std::erase_if(this->_M_misses, [this](const Miss &miss) { return miss.done <= this->_M_now; });
+		if (valid && ready) this->_M_take();
+
+		if (!this->_M_replies.empty() && this->_M_replies.front().cycle <= this->_M_now) {
+			const auto &reply = this->_M_replies.front();
+			if (done == 0) done <= 1;
+			rid <= reply.id;
+			rdata <= reply.data;
+			this->_M_replies.erase(this->_M_replies.begin());
+		} else if (done) {
+			done <= 0;
+		}
+
+		const bool next = this->_M_misses.size() < this->_M_cache.config().mshrs && this->_M_replies.size() < kMaxReplies;
+		if (!next) ++this->_M_cache.stats().stalls;
+		if (next != (ready != 0)) ready <= next;
+	}
+
+	/* Nothing in flight, and no request. */
+	bool quiescent() const override {
+		return this->_M_misses.empty() && this->_M_replies.empty() && done == 0 && ready == 1;
+	}
+	void sensitivity(ProbeList &list) override { list.push_back(Probe::make(valid)); }
+
+	void checkpoint(Archive &ar) override {
+		this->_M_cache.checkpoint(ar);
+		ar.vector(this->_M_misses);
+		ar.vector(this->_M_replies);
+		ar.value(this->_M_now);
+		ar.value(this->_M_order);
+	}
+};
+
+} // namespace dark
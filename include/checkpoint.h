@@ -0,0 +1,133 @@
+#pragma once
+#include "archive.h"
+#include "wide.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DARK_HAS_MMAP 1
+#else
+#define DARK_HAS_MMAP 0
+#endif
+
+namespace dark::details {
+
+/**
+ * Checkpoint file layout, in native byte order so that it is used in place:
+ *
+ *   Header, then one ModuleEntry per module, then the data. The registers
+ *   of a module are 2 * words() words per register (committed value, then
+ *   written value), in probe order. The state saved by checkpoint() follows,
+ *   with blocks of Archive::kPageSize bytes or more on page boundaries.
+ */
+namespace checkpoint {
+
+	inline constexpr char kMagic[8]           = "DKCKPT";
+	inline constexpr std::uint32_t kVersion   = 1;
+	inline constexpr std::uint32_t kByteOrder = 0x01020304;
+
+	struct Header {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byte_order;
+		std::uint64_t modules;
+		std::uint64_t cycles;
+		std::uint64_t seed;
+		std::uint64_t engine_offset; // Engine state, as text.
+		std::uint64_t engine_size;
+		std::uint64_t order_offset; // Module order of shuffled runs, one index per module.
+	};
+
+	struct ModuleEntry {
+		std::uint64_t registers;
+		std::uint64_t signature; // Hash of the register widths.
+		std::uint64_t state_offset;
+		std::uint64_t state_size;
+		std::uint64_t custom_offset;
+		std::uint64_t custom_size;
+	};
+
+	/* FNV-1a of the widths, to tell whether a checkpoint fits a design. */
+	inline std::uint64_t signature(const std::vector<std::size_t> &widths) {
+		std::uint64_t hash = 14695981039346656037ull;
+		for (auto width: widths) {
+			hash ^= width;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	[[noreturn]] inline void fail(const std::string &message) {
+		throw std::runtime_error("Checkpoint: " + message);
+	}
+
+	/* Write the file under a temporary name first, so a failed save keeps the old one. */
+	inline void write_file(const std::string &path, const std::vector<std::byte> &data) {
+		const auto temp = path + ".tmp";
+		auto *file      = std::fopen(temp.c_str(), "wb");
+		if (file == nullptr) fail("cannot open " + temp);
+		const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+		if (std::fclose(file) != 0 || !written) fail("cannot write " + temp);
+		std::remove(path.c_str());
+		if (std::rename(temp.c_str(), path.c_str()) != 0) fail("cannot rename " + temp);
+	}
+
+	/* A read-only view of a whole file, mapped where the platform allows it. */
+	class MappedFile {
+	private:
+		const std::byte *_M_data = nullptr;
+		std::size_t _M_size      = 0;
+		std::vector<std::byte> _M_buffer; // When the file is read instead.
+
+	public:
+		explicit MappedFile(const std::string &path) {
+#if DARK_HAS_MMAP
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) fail("cannot open " + path);
+			struct stat info;
+			if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+				::close(fd);
+				fail(path + " is empty");
+			}
+			this->_M_size = static_cast<std::size_t>(info.st_size);
+			void *data    = ::mmap(nullptr, this->_M_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED) fail("cannot map " + path);
+			this->_M_data = static_cast<const std::byte *>(data);
+#else
+			auto *file = std::fopen(path.c_str(), "rb");
+			if (file == nullptr) fail("cannot open " + path);
+			std::fseek(file, 0, SEEK_END);
+			this->_M_buffer.resize(static_cast<std::size_t>(std::ftell(file)));
+			std::fseek(file, 0, SEEK_SET);
+			const auto size = std::fread(this->_M_buffer.data(), 1, this->_M_buffer.size(), file);
+			std::fclose(file);
+			if (size != this->_M_buffer.size()) fail("cannot read " + path);
+			this->_M_data = this->_M_buffer.data();
+			this->_M_size = this->_M_buffer.size();
+#endif
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		~MappedFile() {
+#if DARK_HAS_MMAP
+			::munmap(const_cast<std::byte *>(this->_M_data), this->_M_size);
+#endif
+		}
+
+		const std::byte *data() const { return this->_M_data; }
+		std::size_t size() const { return this->_M_size; }
+	};
+
+} // namespace checkpoint
+
+} // namespace dark::details
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace dark::details {
+
+/**
+ * @brief Byte-oriented LZ77 compression in the LZ4 block layout.
+ * A sequence is a token (literal length << 4 | match length - 4), the
+ * literals, and a 16-bit little-endian offset back to the match. Lengths of
+ * 15 and more continue in extra bytes of 255. The last sequence has no match.
+ * It favours speed over ratio, which suits the repetitive trace blocks.
+ */
+namespace lz {
+
+	inline constexpr std::size_t kMinMatch  = 4;
+	inline constexpr std::size_t kMaxOffset = 65535;
+	inline constexpr std::size_t kHashBits  = 12;
+	inline constexpr std::size_t kTailSize  = 12; // Bytes at the end which are always literals.
+
+	inline std::uint32_t load32(const std::uint8_t *ptr) {
+		std::uint32_t value;
+		std::memcpy(&value, ptr, sizeof(value));
+		return value;
+	}
+
+	inline std::size_t hash(std::uint32_t value) {
+		return (value * 2654435761u) >> (32 - kHashBits);
+	}
+
+	inline void put_length(std::vector<std::uint8_t> &out, std::size_t length) {
+		for (; length >= 255; length -= 255) out.push_back(255);
+		out.push_back(static_cast<std::uint8_t>(length));
+	}
+
+	inline void put_sequence(std::vector<std::uint8_t> &out, const std::uint8_t *literals,
+							 std::size_t literal_length, std::size_t offset, std::size_t match_length) {
+		const auto literal_code = literal_length < 15 ? literal_length : 15;
+		const auto match_code   = offset == 0 ? 0 : (match_length - kMinMatch < 15 ? match_length - kMinMatch : 15);
+		out.push_back(static_cast<std::uint8_t>(literal_code << 4 | match_code));
+		if (literal_code == 15) put_length(out, literal_length - 15);
+		out.insert(out.end(), literals, literals + literal_length);
+		if (offset == 0) return;
+		out.push_back(static_cast<std::uint8_t>(offset));
+		out.push_back(static_cast<std::uint8_t>(offset >> 8));
+		if (match_code == 15) put_length(out, match_length - kMinMatch - 15);
+	}
+
+	/* Append the compressed form of [data, data + size) to out. */
+	inline void compress(const std::uint8_t *data, std::size_t size, std::vector<std::uint8_t> &out) {
+		std::uint32_t table[std::size_t(1) << kHashBits] = {};
+		std::size_t anchor = 0; // First byte not yet emitted.
+		std::size_t pos    = 0;
+		const auto limit   = size > kTailSize ? size - kTailSize : 0;
+		while (pos < limit) {
+			const auto value = load32(data + pos);
+			auto &slot       = table[hash(value)];
+			const auto match = static_cast<std::size_t>(slot);
+			slot             = static_cast<std::uint32_t>(pos);
+			if (match >= pos || pos - match > kMaxOffset || load32(data + match) != value) {
+				++pos;
+				continue;
+			}
+			auto length = kMinMatch;
+			while (pos + length < limit && data[match + length] == data[pos + length]) ++length;
+			put_sequence(out, data + anchor, pos - anchor, pos - match, length);
+			pos += length;
+			anchor = pos;
+		}
+		put_sequence(out, data + anchor, size - anchor, 0, 0);
+	}
+
+	/* Decompress exactly size bytes into out. Return false if the input is corrupt. */
+	inline bool decompress(const std::uint8_t *data, std::size_t length, std::uint8_t *out, std::size_t size) {
+		const auto *end = data + length;
+		std::size_t pos = 0;
+		auto get_length = [&](std::size_t &value) {
+			for (std::uint8_t byte = 255; byte == 255; value += byte) {
+				if (data == end) return false;
+				byte = *data++;
+			}
+			return true;
+		};
+		while (data != end) {
+			const auto token    = *data++;
+			std::size_t literal = token >> 4;
+			if (literal == 15 && !get_length(literal)) return false;
+			if (literal > static_cast<std::size_t>(end - data) || literal > size - pos) return false;
+			std::memcpy(out + pos, data, literal);
+			data += literal;
+			pos += literal;
+			if (data == end) break; // The last sequence.
+
+			if (end - data < 2) return false;
+			const std::size_t offset = data[0] | std::size_t(data[1]) << 8;
+			data += 2;
+			std::size_t match = token & 15;
+			if (match == 15 && !get_length(match)) return false;
+			match += kMinMatch;
+			if (offset == 0 || offset > pos || match > size - pos) return false;
+			for (std::size_t i = 0; i < match; ++i, ++pos) out[pos] = out[pos - offset]; // May overlap.
+		}
+		return pos == size;
+	}
+
+} // namespace lz
+
+} // namespace dark::details
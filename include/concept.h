@@ -45,7 +45,11 @@ template<typename _Tp>
 concept has_length = requires { { +_Tp::_Bit_Len } -> std::same_as <std::size_t>; };
 
 template<typename _Tp>
-concept bit_type = has_length<_Tp> && explicit_convertible_to<_Tp, max_size_t>;
+concept bit_type = has_length<_Tp> && _Tp::_Bit_Len <= kMaxLength && explicit_convertible_to<_Tp, max_size_t>;
+
+/* Bit vectors wider than max_size_t, which are read as Bit<_Bit_Len>. */
+template<typename _Tp>
+concept wide_type = has_length<_Tp> && (_Tp::_Bit_Len > kMaxLength);
 
 template<typename _Tp>
 concept int_type = !has_length<_Tp> && implicit_convertible_to<_Tp, max_size_t>;
@@ -60,6 +64,16 @@ template<typename _Tp, std::size_t _Len>
 concept bit_convertible =
 		(bit_type<_Tp> && _Tp::_Bit_Len == _Len) || int_type<_Tp>;
 
+template<typename _Lhs, typename _Rhs>
+concept wide_match =
+		(wide_type<_Lhs> && wide_type<_Rhs> && _Lhs::_Bit_Len == _Rhs::_Bit_Len) // prevent format
+		|| (int_type<_Lhs> && wide_type<_Rhs>)                                   //
+		|| (wide_type<_Lhs> && int_type<_Rhs>);
+
+template<typename _Tp, std::size_t _Len>
+concept wide_convertible =
+		(wide_type<_Tp> && _Tp::_Bit_Len == _Len) || int_type<_Tp>;
+
 template <typename _Tp>
 inline constexpr bool is_reg_v = false;
 template <std::size_t _Len>
@@ -0,0 +1,134 @@
+#pragma once
+#include "iss.h"
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+namespace dark {
+
+/* What a core reports when it retires an instruction. */
+struct Commit {
+	std::uint64_t cycle = 0;
+	std::uint32_t pc    = 0;
+	std::uint32_t insn  = 0;
+	std::uint8_t rd     = 0; // Register written, 0 if none.
+	std::uint8_t store  = 0; // Bytes stored (1, 2 or 4), 0 if none.
+	std::uint32_t value = 0; // Value written to rd.
+	std::uint32_t addr  = 0; // Address of the store.
+	std::uint32_t data  = 0; // Data stored, in the low store bytes.
+
+	friend bool operator==(const Commit &, const Commit &) = default;
+};
+
+/**
+ * @brief Checks the commit stream of a cycle model against an ISS in lockstep:
+ * at each retirement, the ISS executes the same instruction, and the pc,
+ * the register write and the store must match. The last commits are kept
+ * in a ring buffer, which is dumped at the first divergence. After it,
+ * check() fails at once, so the model can stop where it diverged.
+ */
+class Cosim {
+private:
+	Iss &_M_reference;
+	std::vector<Commit> _M_history; // Ring buffer, with a power of two size.
+	std::uint64_t _M_count = 0;     // Commits checked.
+	bool _M_diverged       = false;
+	Commit _M_actual;
+	Commit _M_expected;
+	IssStop _M_stop = IssStop::Limit;
+
+	/* The commit of the next instruction of the reference, which it executes. */
+	Commit _M_step(std::uint64_t cycle) {
+		auto &ref = this->_M_reference;
+		Commit commit;
+		commit.cycle = cycle;
+		commit.pc    = ref.pc();
+		if ((commit.pc & 3) == 0 && commit.pc - ref.base() <= ref.size() - 4)
+			commit.insn = ref.load_word(commit.pc);
+		const auto d = iss::decode(commit.insn);
+		if (iss::writes_rd(d.op) && d.rd != iss::kSink) commit.rd = d.rd;
+		commit.store = static_cast<std::uint8_t>(iss::store_size(d.op));
+		if (commit.store != 0) commit.addr = ref.reg(d.rs1) + d.imm;
+
+		ref.step();
+		this->_M_stop = ref.stop();
+		if (commit.rd != 0) commit.value = ref.reg(commit.rd);
+		if (commit.store != 0 && this->_M_stop != IssStop::Fault) ref.read(commit.addr, &commit.data, commit.store);
+		return commit;
+	}
+
+	static void _M_print(std::ostream &os, const Commit &commit) {
+		const auto fill = os.fill('0');
+		os << "cycle " << std::dec << commit.cycle << " pc " << std::hex << std::setw(8) << commit.pc << " insn "
+		   << std::setw(8) << commit.insn << ' ' << std::setfill(' ') << std::left
+		   << std::setw(commit.rd != 0 || commit.store != 0 ? 6 : 0) << iss::name(iss::decode(commit.insn).op)
+		   << std::right << std::setfill('0');
+		if (commit.rd != 0) os << " x" << std::dec << int(commit.rd) << " <- " << std::hex << std::setw(8) << commit.value;
+		if (commit.store != 0)
+			os << " mem[" << std::setw(8) << commit.addr << "] <- " << std::setw(commit.store * 2) << commit.data
+			   << " (" << std::dec << int(commit.store) << " bytes)";
+		os << std::dec;
+		os.fill(fill);
+	}
+
+public:
+	/* The reference must be in the state the model starts from. */
+	explicit Cosim(Iss &reference, std::size_t history = 64) : _M_reference(reference) {
+		std::size_t size = 1;
+		while (size < history) size <<= 1;
+		this->_M_history.resize(size);
+	}
+
+	/**
+	 * @brief Check one retired instruction. The data of a store is compared in
+	 * its low store bytes only. Return false at the first divergence and after it.
+	 */
+	bool check(const Commit &commit) {
+		if (this->_M_diverged) [[unlikely]] return false;
+		auto expected = this->_M_step(commit.cycle);
+		auto actual   = commit;
+		if (actual.store != 0 && actual.store < 4) actual.data &= (1u << actual.store * 8) - 1;
+		if (actual.rd == 0) actual.value = 0;
+		if (actual.store == 0) actual.addr = actual.data = 0;
+		this->_M_history[this->_M_count++ & (this->_M_history.size() - 1)] = actual;
+		if (actual == expected && this->_M_stop != IssStop::Illegal && this->_M_stop != IssStop::Fault) [[likely]]
+			return true;
+		this->_M_diverged = true;
+		this->_M_actual   = actual;
+		this->_M_expected = expected;
+		return false;
+	}
+
+	bool diverged() const { return this->_M_diverged; }
+	/* Commits checked, including the diverging one. */
+	std::uint64_t count() const { return this->_M_count; }
+	const Commit &actual() const { return this->_M_actual; }
+	const Commit &expected() const { return this->_M_expected; }
+
+	/* The divergence, and the commits before it, oldest first. */
+	void report(std::ostream &os) const {
+		if (!this->_M_diverged) {
+			os << "cosim: " << this->_M_count << " commits match\n";
+			return;
+		}
+		os << "cosim: divergence at commit " << this->_M_count << '\n';
+		if (this->_M_stop == IssStop::Illegal || this->_M_stop == IssStop::Fault)
+			os << "  the reference cannot execute it (" << (this->_M_stop == IssStop::Illegal ? "illegal" : "fault")
+			   << ")\n";
+		os << "  model:     ";
+		_M_print(os, this->_M_actual);
+		os << "\n  reference: ";
+		_M_print(os, this->_M_expected);
+		const auto size  = this->_M_history.size();
+		const auto first = this->_M_count > size ? this->_M_count - size : 0;
+		os << "\nlast " << this->_M_count - first << " commits of the model:\n";
+		for (auto i = first; i < this->_M_count; ++i) {
+			os << "  #" << i + 1 << ' ';
+			_M_print(os, this->_M_history[i & (size - 1)]);
+			os << '\n';
+		}
+	}
+};
+
+} // namespace dark
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+/**
+ * @brief A named event count of a module, such as stalls or flushes.
+ * It is a plain member of the module class (not of its input, output or
+ * private struct), listed by ModuleBase::counters and dumped by the profiler.
+ */
+struct Counter {
+	std::uint64_t value = 0;
+
+	Counter &operator++() {
+		++this->value;
+		return *this;
+	}
+	Counter &operator+=(std::uint64_t count) {
+		this->value += count;
+		return *this;
+	}
+	explicit operator std::uint64_t() const { return this->value; }
+};
+
+/* The counters of a module, by name. */
+class CounterList {
+private:
+	std::vector<std::pair<std::string, const Counter *>> _M_counters;
+
+public:
+	void add(std::string name, const Counter &counter) { this->_M_counters.emplace_back(std::move(name), &counter); }
+
+	auto begin() const { return this->_M_counters.begin(); }
+	auto end() const { return this->_M_counters.end(); }
+	std::size_t size() const { return this->_M_counters.size(); }
+};
+
+namespace details {
+
+	/* Register writes and wire evaluations of the module running on this thread, while profiling. */
+	struct EventCounts {
+		std::uint64_t register_writes  = 0;
+		std::uint64_t wire_evaluations = 0;
+
+		/* The counts of this thread, nullptr if profiling is off. */
+		static inline thread_local constinit EventCounts *current = nullptr;
+
+		static void count_write() {
+			if (auto *counts = current; counts != nullptr) [[unlikely]]
+				++counts->register_writes;
+		}
+		static void count_evaluation() {
+			if (auto *counts = current; counts != nullptr) [[unlikely]]
+				++counts->wire_evaluations;
+		}
+	};
+
+} // namespace details
+
+} // namespace dark
@@ -1,8 +1,18 @@
 #pragma once
+#include "arena.h"
+#include "checkpoint.h"
+#include "dirty.h"
 #include "module.h"
+#include "parallel.h"
+#include "profile.h"
+#include "scheduler.h"
+#include "trace.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <random>
+#include <sstream>
 #include <vector>
 
 namespace dark {
@@ -12,51 +22,685 @@ private:
 	std::vector<std::unique_ptr<ModuleBase>> mod_owned;
 	std::vector<ModuleBase *> modules;
 
+	std::vector<details::DirtyList> dirty_lists = std::vector<details::DirtyList>(1);
+	bool dirty_sync = false;
+	bool full_sync  = true; // Whether the next sync must walk all modules.
+	std::uint64_t detached_epoch = 0; // DirtyList::detached_epoch seen by the last cycle.
+
+	SyncPlan sync_plan;
+	bool plan_stale = true; // Whether sync_plan must be rebuilt.
+
+	struct Gate {
+		ProbeList inputs;
+		std::vector<details::word_t> values;  // Values of the inputs when the module last ran.
+		std::vector<details::word_t> scratch; // Values of the inputs in this cycle.
+		unsigned long long skipped = 0;
+		bool primed = false; // Whether values are valid.
+		bool awake  = true;  // Whether the module runs in this cycle.
+	};
+	std::vector<Gate> gates; // Rebuilt when the modules change.
+	bool gating = false;
+
+	details::RegisterArena arena;
+	ProbeList arena_registers;
+	bool use_arena = false;
+
+	struct Parallel {
+		details::WorkerPool pool;
+		details::TaskScheduler work_tasks;
+		details::TaskScheduler sync_tasks;
+		std::vector<double> cost; // Estimated work() time of each module.
+		bool placed = false;
+
+		explicit Parallel(std::size_t threads)
+			: pool(threads), work_tasks(threads), sync_tasks(threads) {}
+	};
+
+	std::mt19937_64 engine{std::mt19937_64::default_seed};
+	std::uint64_t engine_seed = std::mt19937_64::default_seed;
+	std::vector<std::size_t> shuffled; // Module indices, permuted in place across cycles.
+
+	std::vector<details::WireTracer::Step> wire_order;
+	bool topo_eval  = false;
+	bool topo_stale = true; // Whether wire_order must be rebuilt.
+
+	/* Module costs are measured once in this many cycles. */
+	static constexpr unsigned long long kCostPeriod = 64;
+
+	std::unique_ptr<Parallel> parallel;
+	std::unique_ptr<Trace> trace; // nullptr if tracing is off.
+	std::unique_ptr<Profile> profile; // nullptr if profiling is off.
+
 public:
 	unsigned long long cycles = 0;
 
 private:
 	void sync_all() {
-		for (auto &module: modules)
-			module->sync();
+		if (use_arena) arena.commit();
+		if (dirty_sync && !full_sync)
+			return dirty_lists[0].flush();
+		if (plan_stale) build_plan();
+		if (gating) {
+			for (std::size_t i = 0; i < modules.size(); ++i) sync_module(i);
+		} else {
+			sync_plan.run();
+		}
+		dirty_lists[0].clear();
+		full_sync = false;
+	}
+
+	/* A full sync, one module at a time to time each of them. */
+	void sync_all_sampled() {
+		if (use_arena) arena.commit();
+		if (plan_stale) build_plan();
+		for (std::size_t i = 0; i < modules.size(); ++i) sync_module_sampled(i);
+		dirty_lists[0].clear();
+		full_sync = false;
+	}
+
+	/* The list a worker marks its dirty objects in during this cycle, nullptr if none. */
+	details::DirtyList *dirty_list(std::size_t worker = 0) {
+		/* The trace also compares only the registers written, see Trace::collect. */
+		const bool tracked = dirty_sync || (trace != nullptr && trace->collecting());
+		return tracked ? &dirty_lists[worker] : nullptr;
+	}
+
+	/* Registers written or wires evaluated between cycles are in no list of ours, so sync all. */
+	void check_detached() {
+		const auto epoch = details::DirtyList::take_detached();
+		if (epoch == detached_epoch) return;
+		detached_epoch = epoch;
+		full_sync      = true;
+		if (trace != nullptr) trace->rescan();
+	}
+
+	void build_plan() {
+		sync_plan.clear();
+		for (auto *module: modules) {
+			sync_plan.begin_module();
+			module->plan(sync_plan);
+			sync_plan.end_module();
+		}
+		plan_stale = false;
+	}
+
+	void sync_module(std::size_t i) {
+		if (!gating || gates[i].awake)
+			sync_plan.run(i);
+		else
+			sync_plan.run_idle(i);
+	}
+
+	void build_gates() {
+		gates = std::vector<Gate>(modules.size());
+		for (std::size_t i = 0; i < modules.size(); ++i) {
+			auto &gate = gates[i];
+			ProbeList list;
+			modules[i]->sensitivity(list);
+			std::size_t words = 0;
+			for (auto &probe: list) {
+				if (!probe.connected()) continue; // Never changes.
+				gate.inputs.push_back(probe);
+				words += probe.words();
+			}
+			gate.values.resize(words);
+			gate.scratch.resize(words);
+		}
+	}
+
+	/* Whether module i runs in this cycle: it is busy, or an input changed since it last ran. */
+	bool open_gate(std::size_t i) {
+		auto &gate = gates[i];
+		if (!modules[i]->quiescent()) {
+			gate.primed = false; // Inputs are recorded once it is idle.
+			return gate.awake = true;
+		}
+		bool changed = !gate.primed;
+		auto *value  = gate.values.data();
+		for (auto &probe: gate.inputs) {
+			if (probe.width <= kMaxLength) { // One word, without a copy.
+				const details::word_t word = probe.read();
+				changed |= *value != word;
+				*value++ = word;
+				continue;
+			}
+			const auto words = probe.words();
+			probe.load(gate.scratch.data());
+			if (!std::equal(gate.scratch.data(), gate.scratch.data() + words, value)) {
+				std::copy_n(gate.scratch.data(), words, value);
+				changed = true;
+			}
+			value += words;
+		}
+		gate.primed = true;
+		if (!changed) ++gate.skipped;
+		return gate.awake = changed;
+	}
+
+	void build_wire_order() {
+		details::WireTracer tracer;
+		struct Guard {
+			~Guard() { details::WireTracer::active = nullptr; }
+		} guard;
+		details::WireTracer::active = &tracer;
+		for (auto *module: modules) {
+			ProbeList list;
+			module->probe(list);
+			for (auto &probe: list)
+				if (probe.kind == Probe::Kind::Wire) probe.read();
+		}
+		wire_order = std::move(tracer.order);
+		topo_stale = false;
+	}
+
+	/* Evaluate all wires of this cycle in topological order. */
+	void evaluate_wires() {
+		if (topo_stale) build_wire_order();
+		for (auto [wire, eval]: wire_order) eval(wire);
+	}
+
+	/* Start a cycle of the profile, and return whether its times are sampled. */
+	bool begin_profile() {
+		if (profile == nullptr) [[likely]]
+			return false;
+		profile->begin_cycle(modules.size());
+		return profile->sampled(cycles);
+	}
+
+	void work_module(std::size_t i, bool sample) {
+		if (profile == nullptr) [[likely]]
+			return modules[i]->work();
+		struct Guard {
+			~Guard() { details::EventCounts::current = nullptr; }
+		} guard;
+		auto &entry = profile->entry(i);
+		details::EventCounts::current = &entry.events;
+		++entry.work_calls;
+		if (!sample) return modules[i]->work();
+		const auto start = details::ticks();
+		modules[i]->work();
+		entry.work_ticks += details::ticks() - start;
+		++entry.work_samples;
+	}
+
+	/* sync_module, timed for the profile. */
+	void sync_module_sampled(std::size_t i) {
+		auto &entry      = profile->entry(i);
+		const auto start = details::ticks();
+		sync_module(i);
+		entry.sync_ticks += details::ticks() - start;
+		++entry.sync_samples;
+	}
+
+	/* Wires evaluated before work() are counted apart, as they have no module. */
+	void evaluate_wires_profiled() {
+		if (profile == nullptr) [[likely]]
+			return evaluate_wires();
+		struct Guard {
+			~Guard() { details::EventCounts::current = nullptr; }
+		} guard;
+		details::EventCounts::current = &profile->outside();
+		evaluate_wires();
+	}
+
+	template<typename _Fn>
+	void run_phase(_Fn &fn, details::TaskScheduler &tasks) {
+		using _Clock_t = std::chrono::steady_clock;
+		auto start = _Clock_t::now();
+		tasks.reset();
+		parallel->pool.run(fn);
+		auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(_Clock_t::now() - start);
+		tasks.add_wall_time(static_cast<unsigned long long>(wall.count()));
+	}
+
+	void run_parallel(bool shuffle) {
+		using _Clock_t = std::chrono::steady_clock;
+		auto &[pool, work_tasks, sync_tasks, cost, placed] = *parallel;
+
+		++cycles;
+		const bool timed = begin_profile();
+		check_detached();
+		details::DirtyScope scope(dirty_list()); // Wires read before work() are marked too.
+		if (topo_eval) evaluate_wires_profiled();
+		if (gating && gates.size() != modules.size()) build_gates();
+		if (cost.size() != modules.size()) {
+			cost.assign(modules.size(), 1.0);
+			placed = false;
+		}
+		if (!placed) {
+			work_tasks.assign_by_cost(cost);
+			sync_tasks.assign_even(modules.size());
+			placed = true;
+		}
+		if (shuffle) work_tasks.shuffle(engine);
+
+		const bool sample = cycles % kCostPeriod == 1;
+		auto work = [&](std::size_t worker) {
+			details::DirtyScope scope(dirty_list(worker));
+			work_tasks.execute(worker, [&](std::size_t i) {
+				if (gating && !open_gate(i)) return;
+				if (!sample) return work_module(i, timed);
+				auto start = _Clock_t::now();
+				work_module(i, timed);
+				auto spent = std::chrono::duration<double, std::nano>(_Clock_t::now() - start);
+				cost[i]    = 0.75 * cost[i] + 0.25 * spent.count();
+			});
+		};
+		run_phase(work, work_tasks);
+		if (sample) placed = false; // Place again with the new costs.
+		if (trace != nullptr) [[unlikely]] trace->collect(dirty_lists);
+
+		if (use_arena) arena.commit();
+		if (plan_stale) build_plan();
+		auto sync = [&](std::size_t worker) {
+			if (dirty_sync && !full_sync && !timed)
+				return dirty_lists[worker].flush();
+			sync_tasks.execute(worker, [&](std::size_t i) {
+				if (timed) return sync_module_sampled(i);
+				sync_module(i);
+			});
+			dirty_lists[worker].clear();
+		};
+		run_phase(sync, sync_tasks);
+		full_sync = false;
+		if (trace != nullptr) [[unlikely]] trace->sample(modules, cycles);
+	}
+
+	void run_serial(bool shuffle) {
+		++cycles;
+		const bool timed = begin_profile();
+		check_detached();
+		details::DirtyScope scope(dirty_list()); // Wires read before work() are marked too.
+		if (topo_eval) evaluate_wires_profiled();
+		if (gating && gates.size() != modules.size()) build_gates();
+		for (std::size_t k = 0; k < modules.size(); ++k) {
+			const auto i = shuffle ? shuffled[k] : k;
+			if (gating && !open_gate(i)) continue;
+			work_module(i, timed);
+		}
+		if (trace != nullptr) [[unlikely]] trace->collect(dirty_lists);
+		if (timed) [[unlikely]]
+			sync_all_sampled();
+		else
+			sync_all();
+		if (trace != nullptr) [[unlikely]] trace->sample(modules, cycles);
+	}
+
+	void bind_arena(ModuleBase *module) {
+		ProbeList list;
+		module->probe(list);
+		for (auto &probe: list) {
+			if (probe.kind != Probe::Kind::Register || probe.ops->bind == nullptr) continue;
+			probe.ops->bind(probe.object, arena.allocate());
+			arena_registers.push_back(probe);
+		}
 	}
 
 public:
+	CPU() = default;
+	CPU(const CPU &) = delete;
+	CPU &operator=(const CPU &) = delete;
+	~CPU() {
+		for (auto &probe: arena_registers)
+			probe.ops->bind(probe.object, nullptr);
+	}
+
+	/**
+	 * @brief Only synchronize the registers written and the wires evaluated
+	 * in this cycle, instead of walking every member of every module.
+	 * @attention Only Register and Wire are tracked. Custom syncable members
+	 * will not be synchronized in this mode.
+	 */
+	void enable_dirty_sync(bool enable = true) {
+		dirty_sync = enable;
+		full_sync  = true;
+	}
+
+	/**
+	 * @brief Evaluate all wires at the start of each cycle, in a single pass
+	 * over a topological order discovered from the wires of the modules.
+	 * Wires read during work() are then already evaluated. A wire that is
+	 * needed earlier than the order predicts (e.g. its function only reads
+	 * it under some condition) is still evaluated lazily on first read.
+	 * The order is discovered at the next cycle, by reading every wire once.
+	 * @throw std::logic_error if the wires form a combinational loop.
+	 */
+	void enable_topo_eval(bool enable = true) {
+		topo_eval  = enable;
+		topo_stale = true;
+	}
+
+	/**
+	 * @brief Store all registers of the modules in a contiguous double-buffered
+	 * arena owned by this CPU, so that committing them is a plain memcpy.
+	 * Registers are moved back to inline storage when the CPU is destroyed.
+	 */
+	void enable_arena() {
+		if (use_arena) return;
+		use_arena = true;
+		for (auto *module: modules) bind_arena(module);
+		plan_stale = true; // Registers in the arena need no copy.
+	}
+
+	/**
+	 * @brief Dump the values of all registers and wires after each cycle
+	 * to a file, at time = cycle. VCD can be opened by waveform viewers;
+	 * the binary formats are much smaller, and are converted or queried
+	 * with the trace2vcd and trace_query tools.
+	 * The signals are collected at the end of the next cycle, so modules
+	 * added later are not traced. Use the returned Trace to name modules
+	 * and signals before that.
+	 * @throw std::runtime_error if the file cannot be opened.
+	 */
+	Trace &enable_trace(const std::string &path, TraceFormat format = TraceFormat::Vcd) {
+		trace = std::make_unique<Trace>(path, format);
+		return *trace;
+	}
+
+	/**
+	 * @brief Count, for each module, the calls to work(), the registers it
+	 * writes and the wires it evaluates, and sample the time of its work()
+	 * and of its sync once in period cycles (with the time stamp counter
+	 * where there is one). Counters listed by ModuleBase::counters are
+	 * dumped with them. The file is written at the end of run(), or by
+	 * write_profile(). Use the returned Profile to name modules.
+	 * Sampled cycles sync every module, even with dirty sync.
+	 * @attention Profiling is not free: on a small design with short work()
+	 * (the profile demo), counting costs about 15% of the throughput, and
+	 * sampling once in 64 cycles about 10% more. Raise period to sample less.
+	 */
+	Profile &enable_profiling(const std::string &path, ProfileFormat format = ProfileFormat::Json,
+							  unsigned long long period = 1024) {
+		profile = std::make_unique<Profile>(path, format, period);
+		return *profile;
+	}
+
+	/* @throw std::runtime_error if the profile cannot be written. */
+	void write_profile() const {
+		if (profile != nullptr) profile->write(modules, gated_cycles());
+	}
+
+	/**
+	 * @brief Skip idle modules: a module does not run work(), nor sync its
+	 * registers, in a cycle where quiescent() returns true and no signal of
+	 * its sensitivity() list (by default, the inputs of a Module) changed
+	 * since it last ran. Results match the always-run mode as long as
+	 * quiescent() keeps its promise. The lists are collected at the next cycle.
+	 */
+	void enable_clock_gating(bool enable = true) {
+		gating = enable;
+		gates.clear();
+	}
+
+	/* Number of cycles each module was skipped, since clock gating was enabled. */
+	std::vector<unsigned long long> gated_cycles() const {
+		std::vector<unsigned long long> result(modules.size());
+		for (std::size_t i = 0; i < gates.size(); ++i) result[i] = gates[i].skipped;
+		return result;
+	}
+
+	/**
+	 * @brief Run the work and sync phases of each cycle on this many threads
+	 * (including the calling one). Modules are placed on threads by their
+	 * measured cost, and idle threads steal modules from busy ones.
+	 * @attention work() of different modules may run concurrently. A module
+	 * must only write its own registers and must not share mutable state
+	 * with other modules without synchronization.
+	 */
+	void set_threads(std::size_t threads) {
+		parallel.reset();
+		if (threads > 1) parallel = std::make_unique<Parallel>(threads);
+		dirty_lists = std::vector<details::DirtyList>(std::max<std::size_t>(threads, 1));
+		full_sync = true;
+	}
+
 	/// @attention the pointer will be moved. you SHOULD NOT use it after calling this function.
 	template<typename _Tp>
 		requires std::derived_from<_Tp, ModuleBase>
 	void add_module(std::unique_ptr<_Tp> &module) {
+		full_sync  = true;
+		topo_stale = true;
+		plan_stale = true;
+		if (use_arena) bind_arena(module.get());
 		modules.push_back(module.get());
 		mod_owned.emplace_back(std::move(module));
 	}
 	void add_module(std::unique_ptr<ModuleBase> module) {
+		full_sync  = true;
+		topo_stale = true;
+		plan_stale = true;
+		if (use_arena) bind_arena(module.get());
 		modules.push_back(module.get());
 		mod_owned.emplace_back(std::move(module));
 	}
 	void add_module(ModuleBase *module) {
+		full_sync  = true;
+		topo_stale = true;
+		plan_stale = true;
+		if (use_arena) bind_arena(module);
 		modules.push_back(module);
 	}
 
+	/**
+	 * @brief Seed the engine which decides the module order of shuffled runs.
+	 * Running the same design with the same seed replays the same orders.
+	 */
+	void set_seed(std::uint64_t seed) {
+		engine.seed(seed);
+		engine_seed = seed;
+		shuffled.clear();
+	}
+	std::uint64_t seed() const { return engine_seed; }
+
+	/**
+	 * @brief Statistics of each thread in parallel mode, accumulated over
+	 * both the work and the sync phase. Empty in single-threaded mode.
+	 */
+	std::vector<ThreadStats> thread_stats() const {
+		std::vector<ThreadStats> result;
+		if (parallel == nullptr) return result;
+		for (std::size_t w = 0; w < parallel->pool.size(); ++w) {
+			auto &work = parallel->work_tasks.stats(w);
+			auto &sync = parallel->sync_tasks.stats(w);
+			result.push_back({
+					.busy_ns = work.busy_ns + sync.busy_ns,
+					.wall_ns = work.wall_ns + sync.wall_ns,
+					.tasks   = work.tasks + sync.tasks,
+					.steals  = work.steals + sync.steals,
+			});
+		}
+		return result;
+	}
+
+	/**
+	 * @brief How much state each module holds, in the order of add_module.
+	 * Full syncs run a plan built once from these modules, which copies
+	 * each register and marks each wire stale, with no walk of the members.
+	 * Modules which do not override plan() are opaque: their sync() is called.
+	 */
+	const std::vector<SyncStats> &sync_stats() {
+		if (plan_stale) build_plan();
+		return sync_plan.stats();
+	}
+
+	/**
+	 * @brief Save the state of the simulation between two cycles: the committed
+	 * and written values of every probed register, the state each module saves
+	 * in ModuleBase::checkpoint, the cycle count and the shuffle engine.
+	 * Wires hold no state, as they are evaluated again from the registers.
+	 * @throw std::runtime_error if the file cannot be written.
+	 */
+	void save(const std::string &path) const {
+		using namespace details::checkpoint;
+		std::vector<std::byte> data(sizeof(Header) + modules.size() * sizeof(ModuleEntry));
+		std::vector<ModuleEntry> entries;
+		auto align = [&data] { // Keep the arrays of words aligned.
+			constexpr auto word = sizeof(details::word_t);
+			data.resize((data.size() + word - 1) / word * word);
+		};
+		for (auto *module: modules) {
+			ProbeList list;
+			module->probe(list);
+			std::vector<std::size_t> widths;
+			std::vector<details::word_t> state;
+			for (auto &probe: list) {
+				if (probe.kind != Probe::Kind::Register) continue;
+				widths.push_back(probe.width);
+				state.resize(state.size() + 2 * probe.words());
+				probe.save(state.data() + state.size() - 2 * probe.words());
+			}
+			align();
+			auto &entry        = entries.emplace_back();
+			entry.registers    = widths.size();
+			entry.signature    = signature(widths);
+			entry.state_offset = data.size();
+			entry.state_size   = state.size() * sizeof(details::word_t);
+			auto *bytes        = reinterpret_cast<const std::byte *>(state.data());
+			data.insert(data.end(), bytes, bytes + entry.state_size);
+
+			Archive archive(data);
+			const auto begin    = data.size();
+			module->checkpoint(archive);
+			entry.custom_offset = begin;
+			entry.custom_size   = data.size() - begin;
+		}
+
+		/* Shuffles permute the last order, so it is part of the state. */
+		std::vector<std::uint64_t> order(modules.size());
+		for (std::size_t i = 0; i < modules.size(); ++i)
+			order[i] = shuffled.size() == modules.size() ? shuffled[i] : i;
+		align();
+		const auto order_offset = data.size();
+		auto *indices           = reinterpret_cast<const std::byte *>(order.data());
+		data.insert(data.end(), indices, indices + order.size() * sizeof(std::uint64_t));
+
+		std::ostringstream engine_state;
+		engine_state << engine;
+		const auto text = engine_state.str();
+		Header header{};
+		std::memcpy(header.magic, kMagic, sizeof(kMagic));
+		header.version       = kVersion;
+		header.byte_order    = kByteOrder;
+		header.modules       = modules.size();
+		header.cycles        = cycles;
+		header.seed          = engine_seed;
+		header.engine_offset = data.size();
+		header.engine_size   = text.size();
+		header.order_offset  = order_offset;
+		auto *chars          = reinterpret_cast<const std::byte *>(text.data());
+		data.insert(data.end(), chars, chars + text.size());
+
+		std::memcpy(data.data(), &header, sizeof(header));
+		std::memcpy(data.data() + sizeof(header), entries.data(), entries.size() * sizeof(ModuleEntry));
+		write_file(path, data);
+	}
+
+	/**
+	 * @brief Restore a state saved by save(), into a CPU with the same modules,
+	 * added in the same order and connected the same way. The file is mapped,
+	 * so restoring costs little more than copying the state. The whole file
+	 * is checked before anything is restored.
+	 * @throw std::runtime_error if the file is not a checkpoint of this design.
+	 */
+	void load(const std::string &path) {
+		using namespace details::checkpoint;
+		MappedFile file(path);
+		const auto *base = file.data();
+		auto in_file     = [&](std::uint64_t offset, std::uint64_t size) {
+			return offset <= file.size() && size <= file.size() - offset;
+		};
+
+		Header header;
+		if (file.size() < sizeof(header)) fail(path + " is not a checkpoint");
+		std::memcpy(&header, base, sizeof(header));
+		if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) fail(path + " is not a checkpoint");
+		if (header.version != kVersion || header.byte_order != kByteOrder)
+			fail(path + " has another version or byte order");
+		if (header.modules != modules.size()) fail("the number of modules differs");
+		if (!in_file(sizeof(header), header.modules * sizeof(ModuleEntry)) ||
+			!in_file(header.engine_offset, header.engine_size) ||
+			!in_file(header.order_offset, header.modules * sizeof(std::uint64_t)))
+			fail(path + " is truncated");
+
+		/* Check everything first, so that a bad file leaves the CPU as it was. */
+		std::vector<ModuleEntry> entries(modules.size());
+		std::vector<ProbeList> lists(modules.size());
+		for (std::size_t m = 0; m < modules.size(); ++m) {
+			auto &entry = entries[m];
+			std::memcpy(&entry, base + sizeof(header) + m * sizeof(ModuleEntry), sizeof(entry));
+			modules[m]->probe(lists[m]);
+			std::vector<std::size_t> widths;
+			std::size_t words = 0;
+			for (auto &probe: lists[m]) {
+				if (probe.kind != Probe::Kind::Register) continue;
+				widths.push_back(probe.width);
+				words += 2 * probe.words();
+			}
+			if (entry.registers != widths.size() || entry.signature != signature(widths))
+				fail("the registers of module " + std::to_string(m) + " differ");
+			if (entry.state_size != words * sizeof(details::word_t) || !in_file(entry.state_offset, entry.state_size) ||
+				!in_file(entry.custom_offset, entry.custom_size))
+				fail(path + " is truncated");
+			if (entry.state_offset % alignof(details::word_t) != 0) fail(path + " is corrupt");
+		}
+
+		std::vector<std::uint64_t> order(modules.size());
+		std::memcpy(order.data(), base + header.order_offset, order.size() * sizeof(std::uint64_t));
+		std::vector<bool> seen(modules.size());
+		for (auto index: order) { // A permutation of the modules.
+			if (index >= modules.size() || seen[index]) fail(path + " is corrupt");
+			seen[index] = true;
+		}
+
+		std::mt19937_64 saved_engine;
+		std::istringstream engine_state(
+				std::string(reinterpret_cast<const char *>(base + header.engine_offset), header.engine_size));
+		engine_state >> saved_engine;
+		if (!engine_state) fail(path + " is corrupt");
+
+		for (std::size_t m = 0; m < modules.size(); ++m) {
+			const auto &entry = entries[m];
+			auto *state       = reinterpret_cast<const details::word_t *>(base + entry.state_offset);
+			for (auto &probe: lists[m]) {
+				if (probe.kind == Probe::Kind::Register) {
+					probe.restore(state);
+					state += 2 * probe.words();
+				}
+				else {
+					probe.sync(); // Forget the value cached before loading.
+				}
+			}
+			Archive archive(base, entry.custom_offset, entry.custom_offset + entry.custom_size);
+			modules[m]->checkpoint(archive);
+		}
+		engine = saved_engine;
+		shuffled.assign(order.begin(), order.end());
+		engine_seed = header.seed;
+		cycles      = header.cycles;
+		for (auto &list: dirty_lists) list.clear();
+		full_sync = true;
+		for (auto &gate: gates) gate.primed = false;
+		if (trace != nullptr) trace->rescan();
+	}
+
 	void run_once() {
-		++cycles;
-		for (auto &module: modules)
-			module->work();
-		sync_all();
+		if (parallel != nullptr) return run_parallel(false);
+		run_serial(false);
 	}
 	void run_once_shuffle() {
-		static std::default_random_engine engine;
-		std::vector<ModuleBase *> shuffled = modules;
-		std::shuffle(shuffled.begin(), shuffled.end(), engine);
-
-		++cycles;
-		for (auto &module: shuffled)
-			module->work();
-		sync_all();
+		if (parallel != nullptr) return run_parallel(true);
+		if (shuffled.size() != modules.size()) {
+			shuffled.resize(modules.size());
+			for (std::size_t i = 0; i < modules.size(); ++i) shuffled[i] = i;
+		}
+		details::shuffle(shuffled.begin(), shuffled.end(), engine);
+		run_serial(true);
 	}
 	void run(unsigned long long max_cycles = 0, bool shuffle = false) {
 		auto func = shuffle ? &CPU::run_once_shuffle : &CPU::run_once;
 		while (max_cycles == 0 || cycles < max_cycles)
 			(this->*func)();
+		write_profile();
 	}
 };
 
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace dark::details {
+
+/**
+ * @brief Objects which need synchronization at the end of this cycle.
+ * Registers append themselves when written and wires when evaluated,
+ * so that the sync phase only touches the state that changed.
+ */
+struct DirtyList {
+private:
+	using _Sync_t = void (*)(void *);
+
+	struct _Entry {
+		void *object;
+		_Sync_t sync;
+	};
+
+	std::vector<_Entry> _M_entries;
+
+public:
+	/* The list collecting dirty objects of this thread, nullptr if tracking is off. */
+	static inline thread_local constinit DirtyList *current = nullptr;
+
+	/* Bumped when objects were marked on this thread between cycles, see detached(). */
+	static inline thread_local constinit std::uint64_t detached_epoch = 0;
+
+	/**
+	 * @brief The list of this thread between cycles. Its objects are never
+	 * synced (their owner may be gone); a CPU which finds it non-empty
+	 * syncs all of its modules instead, see take_detached().
+	 */
+	static DirtyList &detached() {
+		static thread_local DirtyList list;
+		return list;
+	}
+
+	/* Empty the detached list, and return the epoch of this thread. */
+	static std::uint64_t take_detached() {
+		if (auto &list = detached(); list.size() != 0) {
+			list.clear();
+			++detached_epoch;
+		}
+		return detached_epoch;
+	}
+
+	static void mark(void *object, _Sync_t sync) {
+		if (current != nullptr) current->_M_entries.push_back({object, sync});
+	}
+
+	void flush() {
+		for (auto [object, sync]: this->_M_entries) sync(object);
+		this->_M_entries.clear();
+	}
+
+	void clear() { this->_M_entries.clear(); }
+	std::size_t size() const { return this->_M_entries.size(); }
+
+	/* Call fn with each object in the list. */
+	template<typename _Fn>
+	void visit(_Fn &&fn) const {
+		for (auto [object, sync]: this->_M_entries) fn(object);
+	}
+};
+
+/**
+ * @brief Marks the dirty objects of this thread in a list (none if nullptr)
+ * for one cycle. On exit, objects go to the list of the enclosing scope, or
+ * to the detached list of the thread if there is none.
+ */
+class DirtyScope {
+private:
+	DirtyList *_M_saved;
+
+	/* Number of scopes open on this thread. */
+	static inline thread_local constinit std::size_t depth = 0;
+
+public:
+	explicit DirtyScope(DirtyList *list) : _M_saved(DirtyList::current) {
+		DirtyList::current = list;
+		++depth;
+	}
+	~DirtyScope() { DirtyList::current = --depth == 0 ? &DirtyList::detached() : this->_M_saved; }
+
+	DirtyScope(const DirtyScope &) = delete;
+	DirtyScope &operator=(const DirtyScope &) = delete;
+};
+
+} // namespace dark::details
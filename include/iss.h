@@ -0,0 +1,464 @@
+#pragma once
+#include "bit_impl.h"
+#include "probe.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/* Threaded dispatch needs labels as values (GCC, Clang). Define DARK_ISS_NO_THREADED to use a switch. */
+#if defined(__GNUC__) && !defined(DARK_ISS_NO_THREADED)
+#define DARK_ISS_THREADED 1
+#else
+#define DARK_ISS_THREADED 0
+#endif
+
+namespace dark {
+
+namespace iss {
+
+#define DARK_ISS_OPS(X)                                                                                                \
+	X(Decode) X(Illegal) X(Lui) X(Auipc) X(Jal) X(Jalr) X(Beq) X(Bne) X(Blt) X(Bge) X(Bltu) X(Bgeu) X(Lb) X(Lh) X(Lw)  \
+	X(Lbu) X(Lhu) X(Sb) X(Sh) X(Sw) X(Addi) X(Slti) X(Sltiu) X(Xori) X(Ori) X(Andi) X(Slli) X(Srli) X(Srai) X(Add)     \
+	X(Sub) X(Sll) X(Slt) X(Sltu) X(Xor) X(Srl) X(Sra) X(Or) X(And) X(Fence) X(Ecall) X(Ebreak) X(Mul) X(Mulh)          \
+	X(Mulhsu) X(Mulhu) X(Div) X(Divu) X(Rem) X(Remu)
+
+#define DARK_ISS_ENUM(name) name,
+	enum class Op : std::uint8_t { DARK_ISS_OPS(DARK_ISS_ENUM) };
+#undef DARK_ISS_ENUM
+
+	inline const char *name(Op op) {
+#define DARK_ISS_NAME(name) #name,
+		static constexpr const char *kNames[] = {DARK_ISS_OPS(DARK_ISS_NAME)};
+#undef DARK_ISS_NAME
+		return kNames[static_cast<std::size_t>(op)];
+	}
+
+	/* Register 32 absorbs the writes to x0, so that x0 need not be reset. */
+	inline constexpr std::uint8_t kSink = 32;
+
+	/* A predecoded instruction. Op::Decode (all zero) marks an entry not decoded yet. */
+	struct Decoded {
+		Op op;
+		std::uint8_t rd;
+		std::uint8_t rs1;
+		std::uint8_t rs2;
+		std::uint32_t imm;
+	};
+
+	inline Decoded decode(std::uint32_t insn) {
+		const auto opcode = insn & 0x7f;
+		const auto funct3 = (insn >> 12) & 7;
+		const auto funct7 = insn >> 25;
+		const auto rd     = static_cast<std::uint8_t>((insn >> 7) & 31);
+		Decoded d{Op::Illegal, rd == 0 ? kSink : rd, static_cast<std::uint8_t>((insn >> 15) & 31),
+				  static_cast<std::uint8_t>((insn >> 20) & 31), 0};
+
+		const auto imm_i = static_cast<std::uint32_t>(sign_extend<12>(insn >> 20));
+		const auto imm_s = static_cast<std::uint32_t>(sign_extend<12>((funct7 << 5) | ((insn >> 7) & 31)));
+		const auto imm_b = static_cast<std::uint32_t>(sign_extend<13>(
+				((insn >> 31) << 12) | (((insn >> 7) & 1) << 11) | (((insn >> 25) & 0x3f) << 5) | (((insn >> 8) & 15) << 1)));
+		const auto imm_j = static_cast<std::uint32_t>(sign_extend<21>(
+				((insn >> 31) << 20) | (((insn >> 12) & 0xff) << 12) | (((insn >> 20) & 1) << 11) | (((insn >> 21) & 0x3ff) << 1)));
+
+		switch (opcode) {
+			case 0x37: d.op = Op::Lui, d.imm = insn & 0xfffff000; break;
+			case 0x17: d.op = Op::Auipc, d.imm = insn & 0xfffff000; break;
+			case 0x6f: d.op = Op::Jal, d.imm = imm_j; break;
+			case 0x67:
+				if (funct3 == 0) d.op = Op::Jalr, d.imm = imm_i;
+				break;
+			case 0x63: {
+				static constexpr Op kBranch[8] = {Op::Beq,     Op::Bne, Op::Illegal, Op::Illegal,
+												  Op::Blt,     Op::Bge, Op::Bltu,    Op::Bgeu};
+				d.op  = kBranch[funct3];
+				d.imm = imm_b;
+				break;
+			}
+			case 0x03: {
+				static constexpr Op kLoad[8] = {Op::Lb,  Op::Lh,  Op::Lw,      Op::Illegal,
+												Op::Lbu, Op::Lhu, Op::Illegal, Op::Illegal};
+				d.op  = kLoad[funct3];
+				d.imm = imm_i;
+				break;
+			}
+			case 0x23: {
+				static constexpr Op kStore[8] = {Op::Sb,      Op::Sh,      Op::Sw,      Op::Illegal,
+												 Op::Illegal, Op::Illegal, Op::Illegal, Op::Illegal};
+				d.op  = kStore[funct3];
+				d.imm = imm_s;
+				break;
+			}
+			case 0x13: {
+				static constexpr Op kImm[8] = {Op::Addi, Op::Slli, Op::Slti, Op::Sltiu,
+											   Op::Xori, Op::Srli, Op::Ori,  Op::Andi};
+				d.op  = kImm[funct3];
+				d.imm = imm_i;
+				if (funct3 == 1 && funct7 != 0) d.op = Op::Illegal;
+				if (funct3 == 5) {
+					if (funct7 == 0x20) d.op = Op::Srai;
+					else if (funct7 != 0) d.op = Op::Illegal;
+				}
+				if (funct3 == 1 || funct3 == 5) d.imm &= 31;
+				break;
+			}
+			case 0x33: {
+				static constexpr Op kReg[8] = {Op::Add, Op::Sll, Op::Slt, Op::Sltu, Op::Xor, Op::Srl, Op::Or, Op::And};
+				static constexpr Op kMul[8] = {Op::Mul, Op::Mulh, Op::Mulhsu, Op::Mulhu,
+											   Op::Div, Op::Divu, Op::Rem,    Op::Remu};
+				if (funct7 == 0) d.op = kReg[funct3];
+				else if (funct7 == 1) d.op = kMul[funct3];
+				else if (funct7 == 0x20 && funct3 == 0) d.op = Op::Sub;
+				else if (funct7 == 0x20 && funct3 == 5) d.op = Op::Sra;
+				break;
+			}
+			case 0x0f: d.op = Op::Fence, d.rd = kSink; break; // rd is reserved, never written.
+			case 0x73:
+				if (insn == 0x00000073) d.op = Op::Ecall;
+				else if (insn == 0x00100073) d.op = Op::Ebreak;
+				break;
+		}
+		return d;
+	}
+
+	/* Bytes written to memory by the instruction, 0 if it is not a store. */
+	inline std::uint32_t store_size(Op op) {
+		switch (op) {
+			case Op::Sb: return 1;
+			case Op::Sh: return 2;
+			case Op::Sw: return 4;
+			default: return 0;
+		}
+	}
+
+	/* Whether the instruction writes rd. */
+	inline bool writes_rd(Op op) {
+		switch (op) {
+			case Op::Decode: case Op::Illegal: case Op::Fence: case Op::Ecall: case Op::Ebreak:
+			case Op::Beq: case Op::Bne: case Op::Blt: case Op::Bge: case Op::Bltu: case Op::Bgeu:
+				return false;
+			default: return store_size(op) == 0;
+		}
+	}
+
+} // namespace iss
+
+/* The architectural state of a RV32 hart. x[0] is always 0. */
+struct IssState {
+	std::uint32_t pc = 0;
+	std::array<std::uint32_t, 32> x{};
+};
+
+enum class IssStop : unsigned char {
+	Limit,   // The instruction limit was reached.
+	Ecall,   // An ecall retired.
+	Ebreak,  // An ebreak retired.
+	Illegal, // The instruction at pc is not RV32IM.
+	Fault,   // The instruction at pc accesses memory out of range, or pc is.
+};
+
+/**
+ * @brief A functional RV32IM simulator over a flat memory [base, base + size).
+ * Each instruction is decoded once into a cache parallel to the memory, and
+ * invalidated when it is stored to. The loop jumps from the handler of an
+ * instruction straight to the handler of the next one (threaded dispatch).
+ * It fast-forwards to a region of interest, then hands its state to a cycle
+ * model, and serves as a reference to check one against.
+ */
+class Iss {
+private:
+	std::uint32_t _M_base;
+	std::vector<std::uint8_t> _M_memory;
+	std::vector<iss::Decoded> _M_code; // One entry per word of memory.
+	std::array<std::uint32_t, 33> _M_x{}; // x0..x31, then the sink of x0.
+	std::uint32_t _M_pc;
+	std::uint64_t _M_instret = 0;
+	IssStop _M_stop = IssStop::Limit;
+
+	bool _M_in_range(std::uint32_t addr, std::uint32_t size) const {
+		const auto offset = addr - this->_M_base;
+		return offset <= this->_M_memory.size() && size <= this->_M_memory.size() - offset;
+	}
+
+	void _M_invalidate(std::uint32_t addr, std::uint32_t size) {
+		const auto first = (addr - this->_M_base) >> 2;
+		const auto last  = (addr - this->_M_base + size - 1) >> 2;
+		for (auto i = first; i <= last; ++i) this->_M_code[i].op = iss::Op::Decode;
+	}
+
+	/* The memory size rounded to words, checked before anything is allocated. */
+	static std::size_t _M_checked_size(std::uint32_t base, std::size_t size) {
+		if (size == 0 || size >= (std::size_t{1} << 32) - base) throw std::invalid_argument("Iss: bad memory range");
+		return (size + 3) & ~std::size_t{3};
+	}
+
+public:
+	explicit Iss(std::uint32_t base = 0, std::size_t size = std::size_t{1} << 24)
+		: _M_base(base), _M_memory(_M_checked_size(base, size)), _M_code(_M_memory.size() / 4), _M_pc(base) {}
+
+	/* Copy data into memory, e.g. a program. */
+	void write(std::uint32_t addr, const void *data, std::size_t size) {
+		if (size == 0) return;
+		if (size > 0xffffffffu || !this->_M_in_range(addr, static_cast<std::uint32_t>(size)))
+			throw std::out_of_range("Iss: write out of memory");
+		std::memcpy(this->_M_memory.data() + (addr - this->_M_base), data, size);
+		this->_M_invalidate(addr, static_cast<std::uint32_t>(size));
+	}
+
+	void read(std::uint32_t addr, void *data, std::size_t size) const {
+		if (size == 0) return;
+		if (size > 0xffffffffu || !this->_M_in_range(addr, static_cast<std::uint32_t>(size)))
+			throw std::out_of_range("Iss: read out of memory");
+		std::memcpy(data, this->_M_memory.data() + (addr - this->_M_base), size);
+	}
+
+	std::uint32_t load_word(std::uint32_t addr) const {
+		std::uint32_t value;
+		this->read(addr, &value, sizeof(value));
+		return value;
+	}
+
+	std::uint32_t base() const { return this->_M_base; }
+	std::size_t size() const { return this->_M_memory.size(); }
+
+	std::uint32_t pc() const { return this->_M_pc; }
+	std::uint32_t reg(std::size_t i) const { return this->_M_x[i]; }
+	void set_pc(std::uint32_t pc) { this->_M_pc = pc; }
+	void set_reg(std::size_t i, std::uint32_t value) {
+		if (i != 0) this->_M_x[i] = value;
+	}
+
+	/* Instructions retired so far. */
+	std::uint64_t instret() const { return this->_M_instret; }
+	/* Why the last run() stopped. */
+	IssStop stop() const { return this->_M_stop; }
+
+	IssState state() const {
+		IssState state;
+		state.pc = this->_M_pc;
+		std::copy_n(this->_M_x.begin(), 32, state.x.begin());
+		return state;
+	}
+	void set_state(const IssState &state) {
+		this->_M_pc = state.pc;
+		std::copy_n(state.x.begin(), 32, this->_M_x.begin());
+		this->_M_x[0] = 0;
+	}
+
+	std::uint64_t step() { return this->run(1); }
+
+	/**
+	 * @brief Run until limit instructions retired, or an ecall / ebreak retired,
+	 * or an instruction cannot execute (see stop()). pc is then the next
+	 * instruction to execute. Return the number of instructions retired.
+	 */
+	std::uint64_t run(std::uint64_t limit) {
+		using iss::Op;
+		auto *const x      = this->_M_x.data();
+		auto *const mem    = this->_M_memory.data();
+		auto *const code   = this->_M_code.data();
+		const auto base    = this->_M_base;
+		const auto size    = static_cast<std::uint32_t>(this->_M_memory.size() - 1); // Last offset.
+		std::uint32_t pc   = this->_M_pc;
+		std::uint64_t left = limit;
+		const iss::Decoded *d;
+
+		auto in_range = [&](std::uint32_t addr, std::uint32_t bytes) { return addr - base <= size + 1 - bytes; };
+		auto load = [&]<typename _Tp>(std::uint32_t addr) {
+			_Tp value;
+			std::memcpy(&value, mem + (addr - base), sizeof(_Tp));
+			return value;
+		};
+		auto store = [&]<typename _Tp>(std::uint32_t addr, _Tp value) {
+			std::memcpy(mem + (addr - base), &value, sizeof(_Tp));
+			code[(addr - base) >> 2].op = Op::Decode;
+			if constexpr (sizeof(_Tp) > 1) code[(addr - base + sizeof(_Tp) - 1) >> 2].op = Op::Decode;
+		};
+
+#if DARK_ISS_THREADED
+#define DARK_ISS_LABEL(name) &&op_##name,
+		static void *const kLabels[] = {DARK_ISS_OPS(DARK_ISS_LABEL)};
+#undef DARK_ISS_LABEL
+#define DARK_ISS_CASE(name) op_##name:
+#define DARK_ISS_DISPATCH() goto *kLabels[static_cast<std::size_t>(d->op)]
+#else
+#define DARK_ISS_CASE(name) case Op::name:
+#define DARK_ISS_DISPATCH() goto dispatch
+#endif
+#define DARK_ISS_FETCH()                                                                                               \
+	do {                                                                                                               \
+		if (pc - base > size || (pc & 3) != 0) [[unlikely]] goto fault;                                                \
+		d = code + ((pc - base) >> 2);                                                                                 \
+		DARK_ISS_DISPATCH();                                                                                           \
+	} while (false)
+/* Retire the instruction, then fetch and dispatch the next one. */
+#define DARK_ISS_NEXT()                                                                                                \
+	do {                                                                                                               \
+		if (--left == 0) goto done;                                                                                    \
+		DARK_ISS_FETCH();                                                                                              \
+	} while (false)
+#define DARK_ISS_LOAD(_Tp, _Ext)                                                                                       \
+	do {                                                                                                               \
+		const std::uint32_t addr = x[d->rs1] + d->imm;                                                                 \
+		if (!in_range(addr, sizeof(_Tp))) [[unlikely]] goto fault;                                                     \
+		x[d->rd] = static_cast<std::uint32_t>(static_cast<_Ext>(load.template operator()<_Tp>(addr)));                 \
+		pc += 4;                                                                                                       \
+		DARK_ISS_NEXT();                                                                                               \
+	} while (false)
+#define DARK_ISS_STORE(_Tp)                                                                                            \
+	do {                                                                                                               \
+		const std::uint32_t addr = x[d->rs1] + d->imm;                                                                 \
+		if (!in_range(addr, sizeof(_Tp))) [[unlikely]] goto fault;                                                     \
+		store.template operator()<_Tp>(addr, static_cast<_Tp>(x[d->rs2]));                                             \
+		pc += 4;                                                                                                       \
+		DARK_ISS_NEXT();                                                                                               \
+	} while (false)
+#define DARK_ISS_BRANCH(cond)                                                                                          \
+	do {                                                                                                               \
+		pc += (cond) ? d->imm : 4;                                                                                     \
+		DARK_ISS_NEXT();                                                                                               \
+	} while (false)
+#define DARK_ISS_ALU(expr)                                                                                             \
+	do {                                                                                                               \
+		x[d->rd] = (expr);                                                                                             \
+		pc += 4;                                                                                                       \
+		DARK_ISS_NEXT();                                                                                               \
+	} while (false)
+
+		this->_M_stop = IssStop::Limit;
+		if (left == 0) return 0;
+		DARK_ISS_FETCH();
+
+#if !DARK_ISS_THREADED
+	dispatch:
+		switch (d->op) {
+#endif
+		DARK_ISS_CASE(Decode) {
+			std::uint32_t insn;
+			std::memcpy(&insn, mem + (pc - base), sizeof(insn));
+			code[(pc - base) >> 2] = iss::decode(insn);
+			DARK_ISS_DISPATCH();
+		}
+		DARK_ISS_CASE(Illegal) {
+			this->_M_stop = IssStop::Illegal;
+			goto done;
+		}
+		DARK_ISS_CASE(Lui) DARK_ISS_ALU(d->imm);
+		DARK_ISS_CASE(Auipc) DARK_ISS_ALU(pc + d->imm);
+		DARK_ISS_CASE(Jal) {
+			x[d->rd] = pc + 4;
+			pc += d->imm;
+			DARK_ISS_NEXT();
+		}
+		DARK_ISS_CASE(Jalr) {
+			const std::uint32_t target = (x[d->rs1] + d->imm) & ~1u;
+			x[d->rd] = pc + 4;
+			pc       = target;
+			DARK_ISS_NEXT();
+		}
+		DARK_ISS_CASE(Beq) DARK_ISS_BRANCH(x[d->rs1] == x[d->rs2]);
+		DARK_ISS_CASE(Bne) DARK_ISS_BRANCH(x[d->rs1] != x[d->rs2]);
+		DARK_ISS_CASE(Blt) DARK_ISS_BRANCH(static_cast<std::int32_t>(x[d->rs1]) < static_cast<std::int32_t>(x[d->rs2]));
+		DARK_ISS_CASE(Bge) DARK_ISS_BRANCH(static_cast<std::int32_t>(x[d->rs1]) >= static_cast<std::int32_t>(x[d->rs2]));
+		DARK_ISS_CASE(Bltu) DARK_ISS_BRANCH(x[d->rs1] < x[d->rs2]);
+		DARK_ISS_CASE(Bgeu) DARK_ISS_BRANCH(x[d->rs1] >= x[d->rs2]);
+		DARK_ISS_CASE(Lb) DARK_ISS_LOAD(std::int8_t, std::int32_t);
+		DARK_ISS_CASE(Lh) DARK_ISS_LOAD(std::int16_t, std::int32_t);
+		DARK_ISS_CASE(Lw) DARK_ISS_LOAD(std::uint32_t, std::uint32_t);
+		DARK_ISS_CASE(Lbu) DARK_ISS_LOAD(std::uint8_t, std::uint32_t);
+		DARK_ISS_CASE(Lhu) DARK_ISS_LOAD(std::uint16_t, std::uint32_t);
+		DARK_ISS_CASE(Sb) DARK_ISS_STORE(std::uint8_t);
+		DARK_ISS_CASE(Sh) DARK_ISS_STORE(std::uint16_t);
+		DARK_ISS_CASE(Sw) DARK_ISS_STORE(std::uint32_t);
+		DARK_ISS_CASE(Addi) DARK_ISS_ALU(x[d->rs1] + d->imm);
+		DARK_ISS_CASE(Slti) DARK_ISS_ALU(static_cast<std::int32_t>(x[d->rs1]) < static_cast<std::int32_t>(d->imm));
+		DARK_ISS_CASE(Sltiu) DARK_ISS_ALU(x[d->rs1] < d->imm);
+		DARK_ISS_CASE(Xori) DARK_ISS_ALU(x[d->rs1] ^ d->imm);
+		DARK_ISS_CASE(Ori) DARK_ISS_ALU(x[d->rs1] | d->imm);
+		DARK_ISS_CASE(Andi) DARK_ISS_ALU(x[d->rs1] & d->imm);
+		DARK_ISS_CASE(Slli) DARK_ISS_ALU(x[d->rs1] << d->imm);
+		DARK_ISS_CASE(Srli) DARK_ISS_ALU(x[d->rs1] >> d->imm);
+		DARK_ISS_CASE(Srai) DARK_ISS_ALU(static_cast<std::uint32_t>(static_cast<std::int32_t>(x[d->rs1]) >> d->imm));
+		DARK_ISS_CASE(Add) DARK_ISS_ALU(x[d->rs1] + x[d->rs2]);
+		DARK_ISS_CASE(Sub) DARK_ISS_ALU(x[d->rs1] - x[d->rs2]);
+		DARK_ISS_CASE(Sll) DARK_ISS_ALU(x[d->rs1] << (x[d->rs2] & 31));
+		DARK_ISS_CASE(Slt) DARK_ISS_ALU(static_cast<std::int32_t>(x[d->rs1]) < static_cast<std::int32_t>(x[d->rs2]));
+		DARK_ISS_CASE(Sltu) DARK_ISS_ALU(x[d->rs1] < x[d->rs2]);
+		DARK_ISS_CASE(Xor) DARK_ISS_ALU(x[d->rs1] ^ x[d->rs2]);
+		DARK_ISS_CASE(Srl) DARK_ISS_ALU(x[d->rs1] >> (x[d->rs2] & 31));
+		DARK_ISS_CASE(Sra) DARK_ISS_ALU(static_cast<std::uint32_t>(static_cast<std::int32_t>(x[d->rs1]) >> (x[d->rs2] & 31)));
+		DARK_ISS_CASE(Or) DARK_ISS_ALU(x[d->rs1] | x[d->rs2]);
+		DARK_ISS_CASE(And) DARK_ISS_ALU(x[d->rs1] & x[d->rs2]);
+		DARK_ISS_CASE(Fence) DARK_ISS_ALU(x[iss::kSink]);
+		DARK_ISS_CASE(Ecall) {
+			this->_M_stop = IssStop::Ecall;
+			pc += 4;
+			--left;
+			goto done;
+		}
+		DARK_ISS_CASE(Ebreak) {
+			this->_M_stop = IssStop::Ebreak;
+			pc += 4;
+			--left;
+			goto done;
+		}
+		DARK_ISS_CASE(Mul) DARK_ISS_ALU(x[d->rs1] * x[d->rs2]);
+		DARK_ISS_CASE(Mulh) DARK_ISS_ALU(static_cast<std::uint32_t>(
+				(std::int64_t{static_cast<std::int32_t>(x[d->rs1])} * static_cast<std::int32_t>(x[d->rs2])) >> 32));
+		DARK_ISS_CASE(Mulhsu) DARK_ISS_ALU(static_cast<std::uint32_t>(
+				(std::int64_t{static_cast<std::int32_t>(x[d->rs1])} * std::int64_t{x[d->rs2]}) >> 32));
+		DARK_ISS_CASE(Mulhu) DARK_ISS_ALU(static_cast<std::uint32_t>((std::uint64_t{x[d->rs1]} * x[d->rs2]) >> 32));
+		DARK_ISS_CASE(Div) {
+			const auto a = static_cast<std::int32_t>(x[d->rs1]), b = static_cast<std::int32_t>(x[d->rs2]);
+			DARK_ISS_ALU(b == 0                      ? ~0u
+						 : (a == INT32_MIN && b == -1) ? x[d->rs1]
+													   : static_cast<std::uint32_t>(a / b));
+		}
+		DARK_ISS_CASE(Divu) DARK_ISS_ALU(x[d->rs2] == 0 ? ~0u : x[d->rs1] / x[d->rs2]);
+		DARK_ISS_CASE(Rem) {
+			const auto a = static_cast<std::int32_t>(x[d->rs1]), b = static_cast<std::int32_t>(x[d->rs2]);
+			DARK_ISS_ALU(b == 0                      ? x[d->rs1]
+						 : (a == INT32_MIN && b == -1) ? 0u
+													   : static_cast<std::uint32_t>(a % b));
+		}
+		DARK_ISS_CASE(Remu) DARK_ISS_ALU(x[d->rs2] == 0 ? x[d->rs1] : x[d->rs1] % x[d->rs2]);
+#if !DARK_ISS_THREADED
+		}
+#endif
+
+	fault: // Nothing retired from pc.
+		this->_M_stop = IssStop::Fault;
+	done:
+		this->_M_pc = pc;
+		const auto retired = limit - left;
+		this->_M_instret += retired;
+		return retired;
+
+#undef DARK_ISS_ALU
+#undef DARK_ISS_BRANCH
+#undef DARK_ISS_STORE
+#undef DARK_ISS_LOAD
+#undef DARK_ISS_NEXT
+#undef DARK_ISS_FETCH
+#undef DARK_ISS_DISPATCH
+#undef DARK_ISS_CASE
+	}
+};
+
+/**
+ * @brief Hand the state of the ISS to the registers of a cycle model,
+ * between two cycles: both the committed and the written value are set.
+ */
+template<std::size_t _Len>
+	requires(_Len <= kMaxLength)
+inline void hand_over(const IssState &state, std::array<Register<_Len>, 32> &regs, Register<_Len> &pc) {
+	auto set = [](Register<_Len> &reg, std::uint32_t value) {
+		const details::word_t words[2] = {value, value};
+		Probe::make(reg).restore(words);
+	};
+	set(pc, state.pc);
+	for (std::size_t i = 0; i < 32; ++i) set(regs[i], state.x[i]);
+}
+
+} // namespace dark
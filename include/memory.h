@@ -0,0 +1,412 @@
+#pragma once
+#include "archive.h"
+#include "module.h"
+#include "register.h"
+#include "wire.h"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DARK_HAS_MMAP 1
+#else
+#define DARK_HAS_MMAP 0
+#endif
+
+namespace dark {
+
+/**
+ * @brief A sparse 32-bit memory, in 4 KiB pages allocated on first write.
+ * Reading a page never written returns zeros. It lives outside the
+ * registers and the sync phase, so its size costs nothing per cycle.
+ * Program files are mapped copy-on-write: the pages of a loaded segment
+ * point into the file mapping, and the kernel copies one on its first write.
+ */
+class Memory {
+public:
+	static constexpr std::uint32_t kPageBits = 12;
+	static constexpr std::uint32_t kPageSize = 1u << kPageBits;
+
+private:
+	struct alignas(kPageSize) Page {
+		std::byte data[kPageSize];
+	};
+
+	/* A file, mapped privately (writes are not seen in the file), or read where mmap is missing. */
+	class File {
+	private:
+		std::byte *_M_data = nullptr;
+		std::size_t _M_size = 0;
+		std::unique_ptr<Page[]> _M_buffer;
+
+	public:
+		explicit File(const std::string &path) {
+#if DARK_HAS_MMAP
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) fail("cannot open " + path);
+			struct stat info;
+			if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+				::close(fd);
+				fail(path + " is empty");
+			}
+			this->_M_size = static_cast<std::size_t>(info.st_size);
+			void *data    = ::mmap(nullptr, this->_M_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED) fail("cannot map " + path);
+			this->_M_data = static_cast<std::byte *>(data);
+#else
+			auto *file = std::fopen(path.c_str(), "rb");
+			if (file == nullptr) fail("cannot open " + path);
+			std::fseek(file, 0, SEEK_END);
+			this->_M_size = static_cast<std::size_t>(std::ftell(file));
+			std::fseek(file, 0, SEEK_SET);
+			if (this->_M_size == 0) {
+				std::fclose(file);
+				fail(path + " is empty");
+			}
+			this->_M_buffer = std::make_unique<Page[]>((this->_M_size + kPageSize - 1) / kPageSize);
+			this->_M_data   = this->_M_buffer[0].data;
+			const auto size = std::fread(this->_M_data, 1, this->_M_size, file);
+			std::fclose(file);
+			if (size != this->_M_size) fail("cannot read " + path);
+#endif
+		}
+
+		File(File &&other) noexcept
+			: _M_data(std::exchange(other._M_data, nullptr)), _M_size(std::exchange(other._M_size, 0)),
+			  _M_buffer(std::move(other._M_buffer)) {}
+		File &operator=(File &&) = delete;
+
+		~File() {
+#if DARK_HAS_MMAP
+			if (this->_M_data != nullptr) ::munmap(this->_M_data, this->_M_size);
+#endif
+		}
+
+		std::byte *data() const { return this->_M_data; }
+		std::size_t size() const { return this->_M_size; }
+	};
+
+	/* Two levels of tables of page pointers, 10 bits of the address each. */
+	static constexpr std::uint32_t kTableBits = (32 - kPageBits) / 2;
+	using Table = std::array<std::byte *, 1u << kTableBits>;
+
+	std::vector<std::unique_ptr<Table>> _M_root = std::vector<std::unique_ptr<Table>>(1u << (32 - kPageBits - kTableBits));
+	std::vector<std::unique_ptr<Page>> _M_owned; // Pages allocated here.
+	std::vector<File> _M_files;                  // Files some pages point into.
+	std::size_t _M_pages = 0;
+
+	[[noreturn]] static void fail(const std::string &message) { throw std::runtime_error("Memory: " + message); }
+
+	std::byte *_M_find(std::uint32_t addr) const {
+		const auto &table = this->_M_root[addr >> (kPageBits + kTableBits)];
+		return table == nullptr ? nullptr : (*table)[(addr >> kPageBits) & ((1u << kTableBits) - 1)];
+	}
+
+	std::byte *&_M_entry(std::uint32_t addr) {
+		auto &table = this->_M_root[addr >> (kPageBits + kTableBits)];
+		if (table == nullptr) table = std::make_unique<Table>();
+		return (*table)[(addr >> kPageBits) & ((1u << kTableBits) - 1)];
+	}
+
+	/* The page of addr, allocated if need be. */
+	std::byte *_M_page(std::uint32_t addr) {
+		auto &entry = this->_M_entry(addr);
+		if (entry == nullptr) [[unlikely]] {
+			entry = this->_M_owned.emplace_back(new Page{})->data;
+			++this->_M_pages;
+		}
+		return entry;
+	}
+
+	template<typename _Tp>
+	static _Tp _M_get(const std::byte *data, std::size_t pos) {
+		_Tp value;
+		std::memcpy(&value, data + pos, sizeof(_Tp));
+		return value;
+	}
+
+	/* Map the file bytes [offset, offset + size) at addr, then zeros up to addr + memsize. */
+	void _M_load(const File &file, std::size_t offset, std::uint32_t addr, std::uint32_t size, std::uint32_t memsize) {
+		if (size > memsize || memsize - 1 > ~addr) fail("segment out of the address space");
+		std::uint64_t pos     = addr;
+		const std::uint64_t end  = std::uint64_t{addr} + size;
+		while (pos < end) {
+			const auto page_end = (pos | (kPageSize - 1)) + 1;
+			const auto from     = offset + (pos - addr);
+			auto &entry         = this->_M_entry(static_cast<std::uint32_t>(pos));
+			if (entry == nullptr && pos % kPageSize == 0 && page_end <= end && from % kPageSize == 0) {
+				entry = file.data() + from; // A whole page, shared with the file until written.
+				++this->_M_pages;
+			} else {
+				const auto count = std::min(page_end, end) - pos;
+				this->write(static_cast<std::uint32_t>(pos), file.data() + from, count);
+			}
+			pos = page_end;
+		}
+		this->fill(static_cast<std::uint32_t>(end), memsize - size);
+	}
+
+	static int _M_digit(char c) {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+public:
+	Memory() = default;
+	Memory(const Memory &) = delete;
+	Memory &operator=(const Memory &) = delete;
+
+	/* Pages present, written or loaded. */
+	std::size_t pages() const { return this->_M_pages; }
+
+	void read(std::uint32_t addr, void *data, std::size_t size) const {
+		auto *out = static_cast<std::byte *>(data);
+		while (size != 0) {
+			const auto offset = addr & (kPageSize - 1);
+			const auto count  = std::min<std::size_t>(size, kPageSize - offset);
+			const auto *page  = this->_M_find(addr);
+			if (page != nullptr) std::memcpy(out, page + offset, count);
+			else std::memset(out, 0, count);
+			out += count, size -= count, addr += static_cast<std::uint32_t>(count);
+		}
+	}
+
+	void write(std::uint32_t addr, const void *data, std::size_t size) {
+		const auto *in = static_cast<const std::byte *>(data);
+		while (size != 0) {
+			const auto offset = addr & (kPageSize - 1);
+			const auto count  = std::min<std::size_t>(size, kPageSize - offset);
+			std::memcpy(this->_M_page(addr) + offset, in, count);
+			in += count, size -= count, addr += static_cast<std::uint32_t>(count);
+		}
+	}
+
+	/* Zero [addr, addr + size), touching only the pages present. */
+	void fill(std::uint32_t addr, std::size_t size) {
+		while (size != 0) {
+			const auto offset = addr & (kPageSize - 1);
+			const auto count  = std::min<std::size_t>(size, kPageSize - offset);
+			if (this->_M_find(addr) != nullptr) std::memset(this->_M_page(addr) + offset, 0, count);
+			size -= count, addr += static_cast<std::uint32_t>(count);
+		}
+	}
+
+	template<typename _Tp>
+		requires std::is_trivially_copyable_v<_Tp>
+	_Tp load(std::uint32_t addr) const {
+		const auto offset = addr & (kPageSize - 1);
+		if (offset <= kPageSize - sizeof(_Tp)) [[likely]] {
+			const auto *page = this->_M_find(addr);
+			return page == nullptr ? _Tp{} : _M_get<_Tp>(page, offset);
+		}
+		_Tp value;
+		this->read(addr, &value, sizeof(_Tp));
+		return value;
+	}
+
+	template<typename _Tp>
+		requires std::is_trivially_copyable_v<_Tp>
+	void store(std::uint32_t addr, _Tp value) {
+		const auto offset = addr & (kPageSize - 1);
+		if (offset <= kPageSize - sizeof(_Tp)) [[likely]]
+			std::memcpy(this->_M_page(addr) + offset, &value, sizeof(_Tp));
+		else
+			this->write(addr, &value, sizeof(_Tp));
+	}
+
+	/* Drop all pages. */
+	void clear() {
+		for (auto &table: this->_M_root) table.reset();
+		this->_M_owned.clear();
+		this->_M_files.clear();
+		this->_M_pages = 0;
+	}
+
+	/**
+	 * @brief Load the PT_LOAD segments of a 32-bit little-endian ELF file
+	 * at their virtual addresses. Return the entry point.
+	 * @throw std::runtime_error if the file cannot be read or is not such an ELF file.
+	 */
+	std::uint32_t load_elf(const std::string &path) {
+		File file(path);
+		const auto *data = file.data();
+		const auto size  = file.size();
+		if (size < 52 || std::memcmp(data, "\x7f" "ELF", 4) != 0) fail(path + " is not an ELF file");
+		if (data[4] != std::byte{1} || data[5] != std::byte{1}) fail(path + " is not a 32-bit little-endian ELF file");
+
+		const auto entry   = _M_get<std::uint32_t>(data, 24);
+		const auto phoff   = _M_get<std::uint32_t>(data, 28);
+		const auto phsize  = _M_get<std::uint16_t>(data, 42);
+		const auto phcount = _M_get<std::uint16_t>(data, 44);
+		if (phsize < 32 || phoff > size || std::size_t{phsize} * phcount > size - phoff)
+			fail(path + " has bad program headers");
+
+		/* All headers are checked first: pages mapped from a file must not outlive it. */
+		for (bool check: {true, false}) {
+			for (std::size_t i = 0; i < phcount; ++i) {
+				const auto at = phoff + i * phsize;
+				if (_M_get<std::uint32_t>(data, at) != 1) continue; // PT_LOAD
+				const auto offset  = _M_get<std::uint32_t>(data, at + 4);
+				const auto vaddr   = _M_get<std::uint32_t>(data, at + 8);
+				const auto filesz  = _M_get<std::uint32_t>(data, at + 16);
+				const auto memsz   = _M_get<std::uint32_t>(data, at + 20);
+				if (!check) {
+					if (memsz != 0) this->_M_load(file, offset, vaddr, filesz, memsz);
+					continue;
+				}
+				if (offset > size || filesz > size - offset) fail(path + " has a segment past its end");
+				if (memsz != 0 && (filesz > memsz || memsz - 1 > ~vaddr))
+					fail(path + " has a segment out of the address space");
+			}
+		}
+		this->_M_files.push_back(std::move(file));
+		return entry;
+	}
+
+	/**
+	 * @brief Load a hex image: "@address" (hex) sets the address, and each
+	 * two-digit hex token is the byte there, e.g. "@00001000 13 05 00 00".
+	 * Tokens are separated by whitespace, and "//" starts a comment.
+	 * @throw std::runtime_error if the file cannot be read or has a bad token.
+	 */
+	void load_hex(const std::string &path) {
+		File file(path);
+		const auto *pos = reinterpret_cast<const char *>(file.data());
+		const auto *end = pos + file.size();
+		std::uint32_t addr   = 0;
+		std::byte *page      = nullptr;
+		std::uint32_t number = ~0u; // Page number of page.
+		while (pos != end) {
+			const char c = *pos;
+			if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+				++pos;
+			} else if (c == '/' && end - pos > 1 && pos[1] == '/') {
+				while (pos != end && *pos != '\n') ++pos;
+			} else if (c == '@') {
+				addr = 0;
+				int digits = 0;
+				for (++pos; pos != end && _M_digit(*pos) >= 0; ++pos, ++digits) addr = addr << 4 | _M_digit(*pos);
+				if (digits == 0 || digits > 8) fail(path + " has a bad address");
+			} else {
+				const int high = _M_digit(c);
+				const int low  = end - pos > 1 ? _M_digit(pos[1]) : -1;
+				if (high < 0 || low < 0 || (end - pos > 2 && _M_digit(pos[2]) >= 0))
+					fail(path + " has a bad byte at offset " +
+						 std::to_string(pos - reinterpret_cast<const char *>(file.data())));
+				if ((addr >> kPageBits) != number) {
+					number = addr >> kPageBits;
+					page   = this->_M_page(addr);
+				}
+				page[addr & (kPageSize - 1)] = static_cast<std::byte>(high << 4 | low);
+				++addr;
+				pos += 2;
+			}
+		}
+	}
+
+	/* Save or restore the pages present. Call it from the checkpoint() of one module. */
+	void checkpoint(Archive &ar) {
+		std::vector<std::uint32_t> numbers;
+		if (ar.saving()) {
+			for (std::uint32_t i = 0; i < this->_M_root.size(); ++i) {
+				if (this->_M_root[i] == nullptr) continue;
+				for (std::uint32_t j = 0; j < (1u << kTableBits); ++j)
+					if ((*this->_M_root[i])[j] != nullptr) numbers.push_back(i << kTableBits | j);
+			}
+		}
+		ar.vector(numbers);
+		if (!ar.saving()) this->clear();
+		for (auto number: numbers) ar.bytes(this->_M_page(number << kPageBits), kPageSize);
+	}
+};
+
+/* The request side of a memory port, as the input of a Module: wires from the requester. */
+struct MemoryRequest {
+	Wire<1> valid;
+	Wire<1> write;
+	Wire<2> size; // log2 of the bytes: 0, 1 or 2.
+	Wire<32> addr;
+	Wire<32> wdata;
+};
+
+/* The response side of a memory port, as the output of a Module. */
+struct MemoryResponse {
+	Register<1> busy;  // A request is in flight: no new one is accepted.
+	Register<1> done;  // The request completes in this cycle.
+	Register<32> rdata; // Data loaded, zero extended.
+};
+
+struct MemoryPort_Private {
+	Register<8> count; // Cycles left before done.
+	Register<32> pending;
+};
+
+/**
+ * @brief A Module in front of a Memory, serving one request at a time with a
+ * fixed latency: a request accepted in a cycle is done latency cycles later.
+ * The access happens when the request is accepted. Ports that share a
+ * Memory must not touch the same bytes in the same cycle, as modules run in
+ * any order.
+ */
+struct MemoryPort : Module<MemoryRequest, MemoryResponse, MemoryPort_Private> {
+	Memory *memory        = nullptr;
+	std::uint32_t latency = 1; // In [1, 255], as count has 8 bits.
+
+	/* @throw std::out_of_range if a request is accepted with latency out of [1, 255]. */
+	void work() override final {
+		const bool accept = busy == 0 && valid;
+		const bool last   = busy && count == 1;
+		if (accept) {
+			if (latency == 0 || latency > 255)
+				throw std::out_of_range("MemoryPort: latency " + std::to_string(latency) + " is not in [1, 255]");
+			const auto where = to_unsigned(addr);
+			max_size_t value = 0;
+			switch (to_unsigned(size)) {
+				case 0:
+					if (write) memory->store<std::uint8_t>(where, static_cast<std::uint8_t>(to_unsigned(wdata)));
+					else value = memory->load<std::uint8_t>(where);
+					break;
+				case 1:
+					if (write) memory->store<std::uint16_t>(where, static_cast<std::uint16_t>(to_unsigned(wdata)));
+					else value = memory->load<std::uint16_t>(where);
+					break;
+				default:
+					if (write) memory->store<std::uint32_t>(where, to_unsigned(wdata));
+					else value = memory->load<std::uint32_t>(where);
+					break;
+			}
+			if (latency <= 1) {
+				rdata <= value;
+			} else {
+				busy <= 1;
+				count <= latency - 1;
+				pending <= value;
+			}
+		}
+		if (busy) count <= count - 1;
+		if (last) {
+			busy <= 0;
+			rdata <= pending;
+		}
+		const bool finish = last || (accept && latency <= 1);
+		if (finish != (done != 0)) done <= finish;
+	}
+
+	/* Idle: nothing in flight and nothing requested. */
+	bool quiescent() const override { return busy == 0 && done == 0; }
+	void sensitivity(ProbeList &list) override { list.push_back(Probe::make(valid)); }
+};
+
+} // namespace dark
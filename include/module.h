@@ -1,4 +1,8 @@
 #pragma once
+#include "archive.h"
+#include "counter.h"
+#include "plan.h"
+#include "probe.h"
 #include "synchronize.h"
 namespace dark {
 
@@ -11,6 +15,18 @@ namespace details {
 struct ModuleBase {
 	virtual void work() = 0;
 	virtual void sync() = 0;
+	/* Collect the registers and wires of this module, if it exposes them. */
+	virtual void probe(ProbeList &) { /* opaque by default */ }
+	/* Save or restore the state not in the probed registers, see CPU::save. */
+	virtual void checkpoint(Archive &) { /* none by default */ }
+	/* Signals whose change wakes this module up, see CPU::enable_clock_gating. */
+	virtual void sensitivity(ProbeList &) { /* none by default */ }
+	/* Whether work() would change nothing while the sensitivity signals keep their values. */
+	virtual bool quiescent() const { return false; }
+	/* Describe the sync actions of this module, see CPU::sync_stats. */
+	virtual void plan(SyncPlan &plan) { plan.add_opaque(*this); }
+	/* Named counters of this module, see CPU::enable_profiling. */
+	virtual void counters(CounterList &) { /* none by default */ }
 	virtual ~ModuleBase() = default;
 };
 
@@ -22,6 +38,19 @@ struct Module : public ModuleBase, public _Tinput, public _Toutput, protected _T
 		sync_member(static_cast<_Toutput &>(*this));
 		sync_member(static_cast<_Tprivate &>(*this));
 	}
+	void plan(SyncPlan &plan) override final {
+		plan_member(static_cast<_Tinput &>(*this), plan);
+		plan_member(static_cast<_Toutput &>(*this), plan);
+		if constexpr (!std::is_same_v<_Tprivate, details::empty_class>)
+			plan_member(static_cast<_Tprivate &>(*this), plan);
+	}
+	/* The input members, unless overridden. */
+	void sensitivity(ProbeList &list) override { probe_member(static_cast<_Tinput &>(*this), list); }
+	void probe(ProbeList &list) override final {
+		probe_member(static_cast<_Tinput &>(*this), list);
+		probe_member(static_cast<_Toutput &>(*this), list);
+		probe_member(static_cast<_Tprivate &>(*this), list);
+	}
 };
 
 } // namespace dark
@@ -1,11 +1,16 @@
 #pragma once
 #include "bit.h"
+#include "simd.h"
+#include "wide.h"
+#include <compare>
 
 namespace dark {
 
 using dark::concepts::bit_match;
 using dark::concepts::bit_type;
 using dark::concepts::int_type;
+using dark::concepts::wide_match;
+using dark::concepts::wide_type;
 
 template<typename _Tp>
 constexpr auto cast(const _Tp &value) {
@@ -119,4 +124,121 @@ constexpr auto operator <=> (const _Tp &lhs, const _Up &rhs) {
 	return cast(lhs) <=> cast(rhs);
 }
 
+/* Operators of wide bit vectors, computed on whole words by the kernels in simd.h. */
+
+template<typename _Tp, typename _Up>
+consteval auto get_wide_length() -> std::size_t {
+	static_assert(wide_match<_Tp, _Up>);
+	if constexpr (wide_type<_Tp>) {
+		return _Tp::_Bit_Len;
+	}
+	else {
+		return _Up::_Bit_Len;
+	}
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator+(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_add(wide_cast<_Len>(lhs), wide_cast<_Len>(rhs), 0);
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator-(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_add(wide_cast<_Len>(lhs), details::wide_not(wide_cast<_Len>(rhs)), 1);
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up> && (get_wide_length<_Tp, _Up>() <= details::kWordBits)
+constexpr auto operator*(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return Bit<_Len>(wide_cast<_Len>(lhs).word(0) * wide_cast<_Len>(rhs).word(0));
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up> && (get_wide_length<_Tp, _Up>() <= details::kWordBits)
+constexpr auto operator/(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return Bit<_Len>(wide_cast<_Len>(lhs).word(0) / wide_cast<_Len>(rhs).word(0));
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator&(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_and(wide_cast<_Len>(lhs), wide_cast<_Len>(rhs));
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator|(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_or(wide_cast<_Len>(lhs), wide_cast<_Len>(rhs));
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator^(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_xor(wide_cast<_Len>(lhs), wide_cast<_Len>(rhs));
+}
+
+/* Shifting by _Len bits or more gives zero. */
+template<wide_type _Tp, int_or_bit _Up>
+constexpr auto operator<<(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = _Tp::_Bit_Len;
+	const auto amount   = static_cast<std::size_t>(cast(rhs));
+	if (amount >= _Len) return Bit<_Len>(0);
+	return details::wide_shift_left(wide_cast<_Len>(lhs), amount);
+}
+
+template<wide_type _Tp, int_or_bit _Up>
+constexpr auto operator>>(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = _Tp::_Bit_Len;
+	const auto amount   = static_cast<std::size_t>(cast(rhs));
+	if (amount >= _Len) return Bit<_Len>(0);
+	return details::wide_shift_right(wide_cast<_Len>(lhs), amount);
+}
+
+template<wide_type _Tp>
+constexpr auto operator~(const _Tp &value) {
+	return details::wide_not(wide_cast<_Tp::_Bit_Len>(value));
+}
+
+template<wide_type _Tp>
+constexpr auto operator!(const _Tp &value) {
+	return ~value;
+}
+
+template<wide_type _Tp>
+constexpr auto operator+(const _Tp &value) {
+	return wide_cast<_Tp::_Bit_Len>(value);
+}
+
+template<wide_type _Tp>
+constexpr auto operator-(const _Tp &value) {
+	return Bit<_Tp::_Bit_Len>(0) - value;
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr bool operator==(const _Tp &lhs, const _Up &rhs) {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	return details::wide_equal(wide_cast<_Len>(lhs), wide_cast<_Len>(rhs));
+}
+
+template<typename _Tp, typename _Up>
+	requires wide_match<_Tp, _Up>
+constexpr auto operator<=>(const _Tp &lhs, const _Up &rhs) -> std::strong_ordering {
+	constexpr auto _Len = get_wide_length<_Tp, _Up>();
+	const auto left     = wide_cast<_Len>(lhs);
+	const auto right    = wide_cast<_Len>(rhs);
+	for (std::size_t i = Bit<_Len>::_Words; i-- > 0;)
+		if (left.word(i) != right.word(i)) return left.word(i) <=> right.word(i);
+	return std::strong_ordering::equal;
+}
+
 } // namespace dark
@@ -0,0 +1,87 @@
+#pragma once
+#include "wire.h"
+#include <barrier>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dark::details {
+
+/**
+ * @brief A fixed group of threads running fork-join phases.
+ * The calling thread takes part in every phase as worker 0.
+ */
+class WorkerPool {
+private:
+	using _Job_t = void (*)(void *, std::size_t);
+
+	std::size_t _M_size;
+	std::barrier<> _M_start;
+	std::barrier<> _M_done;
+	std::vector<std::jthread> _M_threads;
+
+	_Job_t _M_job     = nullptr;
+	void *_M_context  = nullptr;
+	bool _M_stop      = false;
+
+	std::mutex _M_mutex;
+	std::exception_ptr _M_error;
+
+	void _M_execute(std::size_t worker) {
+		try {
+			this->_M_job(this->_M_context, worker);
+		} catch (...) {
+			std::lock_guard lock{this->_M_mutex};
+			if (!this->_M_error) this->_M_error = std::current_exception();
+		}
+	}
+
+	void _M_loop(std::size_t worker) {
+		while (true) {
+			this->_M_start.arrive_and_wait();
+			if (this->_M_stop) return;
+			this->_M_execute(worker);
+			this->_M_done.arrive_and_wait();
+		}
+	}
+
+public:
+	explicit WorkerPool(std::size_t size)
+		: _M_size(size), _M_start(size), _M_done(size) {
+		for (std::size_t i = 1; i < size; ++i)
+			this->_M_threads.emplace_back([this, i] { this->_M_loop(i); });
+	}
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	~WorkerPool() {
+		this->_M_stop = true;
+		this->_M_start.arrive_and_wait();
+	}
+
+	std::size_t size() const { return this->_M_size; }
+
+	/**
+	 * @brief Run fn(worker) on every worker and wait for all of them.
+	 * The first exception thrown by any worker is rethrown here.
+	 */
+	template<typename _Fn>
+	void run(_Fn &fn) {
+		this->_M_job = [](void *context, std::size_t worker) {
+			(*static_cast<_Fn *>(context))(worker);
+		};
+		this->_M_context = &fn;
+		concurrent_phases.fetch_add(1, std::memory_order_relaxed);
+		this->_M_start.arrive_and_wait();
+		this->_M_execute(0);
+		this->_M_done.arrive_and_wait();
+		concurrent_phases.fetch_sub(1, std::memory_order_relaxed);
+		if (this->_M_error) std::rethrow_exception(std::exchange(this->_M_error, nullptr));
+	}
+};
+
+} // namespace dark::details
@@ -0,0 +1,223 @@
+#pragma once
+#include "register.h"
+#include "synchronize.h"
+#include "wire.h"
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace dark {
+
+/* How much state a module holds, as seen by its sync plan. */
+struct SyncStats {
+	std::size_t registers = 0;
+	std::size_t wires     = 0;
+	std::size_t calls     = 0;     // Members or modules synced by their own sync().
+	std::size_t bits      = 0;     // Total width of the registers.
+	std::size_t bytes     = 0;     // Bytes copied by each sync.
+	bool opaque           = false; // Whether the module does not describe its members.
+};
+
+/**
+ * @brief The sync phase of a CPU, flattened once into a contiguous list of
+ * actions, grouped by module, where members at a regular stride (arrays)
+ * share one action. Syncing is then a loop over the list, with no virtual
+ * call nor walk of the members, except for members and modules that
+ * have a custom sync(), which are called through a function pointer.
+ */
+class SyncPlan {
+private:
+	/* An action on count objects, stride bytes apart, e.g. the registers of an array. */
+	struct Action {
+		enum class Kind : unsigned char { Cell, Words, Stale, Call };
+
+		Kind kind;
+		std::uint32_t size; // Words: number of words.
+		std::size_t count;
+		std::ptrdiff_t stride;
+		void *target;       // Cell / Words: destination. Stale: wire state. Call: object.
+		const void *source; // Cell / Words: source.
+		void (*call)(void *);
+	};
+
+	/* Registers copy their value in place, unless the debug state must be reset too. */
+	static constexpr bool kCopyRegisters = std::is_empty_v<debug::DebugValue<bool, false>>;
+
+	std::vector<Action> _M_actions;
+	std::vector<std::size_t> _M_begin = std::vector<std::size_t>(1); // Actions of module i: [begin[i], begin[i + 1]).
+	std::vector<SyncStats> _M_stats;
+
+	static std::ptrdiff_t _M_distance(const void *from, const void *to) {
+		return static_cast<const std::byte *>(to) - static_cast<const std::byte *>(from);
+	}
+
+	/* Merge the action into the last one of the module if it extends its run. */
+	void _M_push(Action action) {
+		if (this->_M_actions.size() > this->_M_begin.back()) {
+			auto &last = this->_M_actions.back();
+			const bool same = last.kind == action.kind && action.kind != Action::Kind::Call && last.size == action.size &&
+							  (action.source == nullptr ||
+							   _M_distance(last.target, last.source) == _M_distance(action.target, action.source));
+			const auto step = _M_distance(last.target, action.target);
+			if (same && last.count == 1 && step != 0) {
+				last.stride = step;
+				last.count  = 2;
+				return;
+			}
+			if (same && step == last.stride * static_cast<std::ptrdiff_t>(last.count)) {
+				++last.count;
+				return;
+			}
+		}
+		this->_M_actions.push_back(action);
+	}
+
+	template<typename _Tp>
+	void _M_push_call(_Tp &value) {
+		this->_M_push({Action::Kind::Call, 0, 1, 0, &value, nullptr, [](void *ptr) { Visitor::sync(*static_cast<_Tp *>(ptr)); }});
+	}
+
+	SyncStats &_M_current() { return this->_M_stats.back(); }
+
+	template<bool _Registers = true>
+	static void _M_run(const Action *first, const Action *last) {
+		for (; first != last; ++first) {
+			auto *target       = static_cast<std::byte *>(first->target);
+			const auto *source = static_cast<const std::byte *>(first->source);
+			const auto stride  = first->stride;
+			if constexpr (!_Registers)
+				if (first->kind == Action::Kind::Cell || first->kind == Action::Kind::Words) continue;
+			switch (first->kind) {
+				case Action::Kind::Cell:
+					for (std::size_t i = 0; i < first->count; ++i, target += stride, source += stride)
+						std::memcpy(target, source, sizeof(max_size_t));
+					break;
+				case Action::Kind::Words:
+					for (std::size_t i = 0; i < first->count; ++i, target += stride, source += stride)
+						std::memcpy(target, source, first->size * sizeof(details::word_t));
+					break;
+				case Action::Kind::Stale:
+					for (std::size_t i = 0; i < first->count; ++i, target += stride)
+						reinterpret_cast<std::atomic<details::WireState> *>(target)->store(
+								details::WireState::Stale, std::memory_order_relaxed);
+					break;
+				case Action::Kind::Call:
+					first->call(first->target);
+					break;
+			}
+		}
+	}
+
+public:
+	/* Start the actions of the next module. */
+	void begin_module() { this->_M_stats.emplace_back(); }
+	void end_module() { this->_M_begin.push_back(this->_M_actions.size()); }
+
+	template<std::size_t _Len>
+	void add(Register<_Len> &reg) {
+		auto &stats = this->_M_current();
+		++stats.registers;
+		stats.bits += _Len;
+		if constexpr (!kCopyRegisters) {
+			this->_M_push_call(reg);
+		}
+		else if constexpr (_Len > kMaxLength) {
+			static_assert(std::is_trivially_copyable_v<Bit<_Len>>);
+			static_assert(sizeof(Bit<_Len>) % sizeof(details::word_t) == 0);
+			constexpr auto words = sizeof(Bit<_Len>) / sizeof(details::word_t);
+			this->_M_push({Action::Kind::Words, words, 1, 0, &reg._M_old, &reg._M_new, nullptr});
+			stats.bytes += sizeof(Bit<_Len>);
+		}
+		else if (reg._M_slot == nullptr) { // Registers in an arena are committed by the arena.
+			static_assert(sizeof(reg._M_old) == sizeof(max_size_t));
+			this->_M_push({Action::Kind::Cell, 0, 1, 0, &reg._M_old, &reg._M_new, nullptr});
+			stats.bytes += sizeof(max_size_t);
+		}
+	}
+
+	template<std::size_t _Len>
+	void add(Wire<_Len> &wire) {
+		++this->_M_current().wires;
+		this->_M_push({Action::Kind::Stale, 0, 1, 0, &wire._M_state, nullptr, nullptr});
+	}
+
+	/* A member synced by its own sync(). */
+	template<typename _Tp>
+		requires Visitor::is_syncable_v<_Tp>
+	void add_call(_Tp &value) {
+		++this->_M_current().calls;
+		this->_M_push_call(value);
+	}
+
+	/* A module which does not describe its members: its sync() is called. */
+	template<typename _Tp>
+	void add_opaque(_Tp &module) {
+		this->add_call(module);
+		this->_M_current().opaque = true;
+	}
+
+	void clear() {
+		this->_M_actions.clear();
+		this->_M_begin.assign(1, 0);
+		this->_M_stats.clear();
+	}
+
+	std::size_t modules() const { return this->_M_stats.size(); }
+	std::size_t size() const { return this->_M_actions.size(); }
+	const std::vector<SyncStats> &stats() const { return this->_M_stats; }
+
+	void run() const { _M_run(this->_M_actions.data(), this->_M_actions.data() + this->_M_actions.size()); }
+
+	/* Sync module i only. */
+	void run(std::size_t i) const {
+		auto *data = this->_M_actions.data();
+		_M_run(data + this->_M_begin[i], data + this->_M_begin[i + 1]);
+	}
+
+	/* Sync module i after a cycle it did not run: its registers hold no new value. */
+	void run_idle(std::size_t i) const {
+		auto *data = this->_M_actions.data();
+		_M_run<false>(data + this->_M_begin[i], data + this->_M_begin[i + 1]);
+	}
+};
+
+template<typename _Tp>
+inline void plan_member(_Tp &value, SyncPlan &plan);
+
+namespace details {
+
+	template<typename _Tp, typename... _Base>
+	inline void plan_by_tag(_Tp &value, SyncPlan &plan, SyncTags<_Base...>) {
+		(plan_member(Visitor::cast<_Tp, _Base>(value), plan), ...);
+	}
+
+} // namespace details
+
+/* Add the sync actions of an object to a plan. It walks the object the same way as sync_member. */
+template<typename _Tp>
+inline void plan_member(_Tp &value, SyncPlan &plan) {
+	if constexpr (std::is_const_v<_Tp>) {
+		/* Constant members need no synchronization. */
+	}
+	else if constexpr (concepts::is_std_array_v<_Tp>) {
+		for (auto &member: value) plan_member(member, plan);
+	}
+	else if constexpr (concepts::is_reg_v<_Tp> || concepts::is_wire_v<_Tp>) {
+		plan.add(value);
+	}
+	else if constexpr (Visitor::is_syncable_v<_Tp>) {
+		plan.add_call(value);
+	}
+	else if constexpr (concepts::has_valid_tag<_Tp>) {
+		details::plan_by_tag(value, plan, typename _Tp::Tags{});
+	}
+	else if constexpr (std::is_aggregate_v<_Tp>) {
+		auto &&tuple = reflect::tuplify(value);
+		std::apply([&plan](auto &...members) { (plan_member(members, plan), ...); }, tuple);
+	}
+	else {
+		static_assert(sizeof(_Tp) == 0, "This type is not syncable.");
+	}
+}
+
+} // namespace dark
@@ -0,0 +1,180 @@
+#pragma once
+#include "register.h"
+#include "synchronize.h"
+#include "wire.h"
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace dark {
+
+/**
+ * @brief A type-erased handle to a register or wire inside a module.
+ * It lets the CPU inspect and manage module state without knowing its type.
+ */
+struct Probe {
+public:
+	enum class Kind : unsigned char { Register, Wire };
+
+	struct Ops {
+		max_size_t (*read)(const void *);
+		void (*bind)(void *, max_size_t *); // Narrow register only.
+		void (*load)(const void *, details::word_t *);
+		bool (*connected)(const void *); // Wire only.
+		void (*sync)(void *);
+		void (*save)(const void *, details::word_t *);    // Register only.
+		void (*restore)(void *, const details::word_t *); // Register only.
+	};
+
+	void *object;
+	const Ops *ops;
+	std::size_t width;
+	Kind kind;
+
+	/* Number of 64-bit words written by load(). */
+	std::size_t words() const { return (this->width + details::kWordBits - 1) / details::kWordBits; }
+
+	template<std::size_t _Len>
+	static Probe make(Register<_Len> &reg) {
+		static constexpr Ops ops = {
+				.read = [](const void *ptr) {
+					return _M_low(static_cast<const Register<_Len> *>(ptr)->_M_read());
+				},
+				.bind = _M_bind_op<_Len>(),
+				.load = [](const void *ptr, details::word_t *words) {
+					_M_store(static_cast<const Register<_Len> *>(ptr)->_M_read(), words);
+				},
+				.connected = nullptr,
+				.sync      = [](void *ptr) { Visitor::sync(*static_cast<Register<_Len> *>(ptr)); },
+				.save      = [](const void *ptr, details::word_t *words) {
+					auto *reg = static_cast<const Register<_Len> *>(ptr);
+					_M_store(reg->_M_read(), words);
+					_M_store(reg->_M_pending(), words + details::kWordCount<_Len>);
+				},
+				.restore = [](void *ptr, const details::word_t *words) {
+					static_cast<Register<_Len> *>(ptr)->_M_restore(
+							_M_value<_Len>(words), _M_value<_Len>(words + details::kWordCount<_Len>));
+				},
+		};
+		return {&reg, &ops, _Len, Kind::Register};
+	}
+
+	template<std::size_t _Len>
+	static Probe make(Wire<_Len> &wire) {
+		using _Value_t = std::conditional_t<(_Len <= kMaxLength), max_size_t, Bit<_Len>>;
+		static constexpr Ops ops = {
+				.read = [](const void *ptr) {
+					return _M_low(static_cast<_Value_t>(*static_cast<const Wire<_Len> *>(ptr)));
+				},
+				.bind = nullptr,
+				.load = [](const void *ptr, details::word_t *words) {
+					_M_store(static_cast<_Value_t>(*static_cast<const Wire<_Len> *>(ptr)), words);
+				},
+				.connected = [](const void *ptr) {
+					return static_cast<const Wire<_Len> *>(ptr)->_M_connected();
+				},
+				.sync    = [](void *ptr) { Visitor::sync(*static_cast<Wire<_Len> *>(ptr)); },
+				.save    = nullptr,
+				.restore = nullptr,
+		};
+		return {&wire, &ops, _Len, Kind::Wire};
+	}
+
+	/* The value, or its low kMaxLength bits if the probe is wider. */
+	max_size_t read() const { return this->ops->read(this->object); }
+
+	/* Write the whole value into words() words, least significant first. */
+	void load(details::word_t *words) const { this->ops->load(this->object, words); }
+
+	/* Synchronize as at the end of a cycle. A wire forgets its cached value. */
+	void sync() const { this->ops->sync(this->object); }
+
+	/**
+	 * Save the state of a register into 2 * words() words: the committed
+	 * value, then the value written in this cycle. Restore reads them back.
+	 */
+	void save(details::word_t *words) const { this->ops->save(this->object, words); }
+	void restore(const details::word_t *words) const { this->ops->restore(this->object, words); }
+
+	/* Whether the value can be read. An unconnected wire cannot. */
+	bool connected() const { return this->ops->connected == nullptr || this->ops->connected(this->object); }
+
+private:
+	static max_size_t _M_low(max_size_t value) { return value; }
+	template<std::size_t _Len>
+	static max_size_t _M_low(const Bit<_Len> &value) { return static_cast<max_size_t>(value.word(0)); }
+
+	static void _M_store(max_size_t value, details::word_t *words) { words[0] = value; }
+	template<std::size_t _Len>
+	static void _M_store(const Bit<_Len> &value, details::word_t *words) {
+		std::ranges::copy(value.words(), words);
+	}
+
+	template<std::size_t _Len>
+	static auto _M_value(const details::word_t *words) {
+		if constexpr (_Len <= kMaxLength) {
+			return static_cast<max_size_t>(words[0]);
+		}
+		else {
+			typename Bit<_Len>::_Array_t array;
+			std::copy_n(words, array.size(), array.begin());
+			return Bit<_Len>(array);
+		}
+	}
+
+	/* Only narrow registers can be moved into a register arena. */
+	template<std::size_t _Len>
+	static constexpr auto _M_bind_op() -> void (*)(void *, max_size_t *) {
+		if constexpr (_Len <= kMaxLength)
+			return [](void *ptr, max_size_t *slot) { static_cast<Register<_Len> *>(ptr)->_M_bind(slot); };
+		else
+			return nullptr;
+	}
+};
+
+using ProbeList = std::vector<Probe>;
+
+template<typename _Tp>
+inline void probe_member(_Tp &value, ProbeList &list);
+
+namespace details {
+
+	template<typename _Tp, typename... _Base>
+	inline void probe_by_tag(_Tp &value, ProbeList &list, SyncTags<_Base...>) {
+		(probe_member(Visitor::cast<_Tp, _Base>(value), list), ...);
+	}
+
+} // namespace details
+
+/**
+ * @brief Collect all registers and wires of an object, in member order.
+ * It walks the object the same way as sync_member. Members with a
+ * custom sync() function are opaque and thus skipped.
+ */
+template<typename _Tp>
+inline void probe_member(_Tp &value, ProbeList &list) {
+	if constexpr (std::is_const_v<_Tp>) {
+		/* Constant members hold no state. */
+	}
+	else if constexpr (concepts::is_std_array_v<_Tp>) {
+		for (auto &member: value) probe_member(member, list);
+	}
+	else if constexpr (concepts::is_reg_v<_Tp> || concepts::is_wire_v<_Tp>) {
+		list.push_back(Probe::make(value));
+	}
+	else if constexpr (Visitor::is_syncable_v<_Tp>) {
+		/* Opaque custom synchronization. */
+	}
+	else if constexpr (concepts::has_valid_tag<_Tp>) {
+		details::probe_by_tag(value, list, typename _Tp::Tags{});
+	}
+	else if constexpr (std::is_aggregate_v<_Tp>) {
+		auto &&tuple = reflect::tuplify(value);
+		std::apply([&list](auto &...members) { (probe_member(members, list), ...); }, tuple);
+	}
+	else {
+		static_assert(sizeof(_Tp) == 0, "This type cannot be probed.");
+	}
+}
+
+} // namespace dark
@@ -0,0 +1,198 @@
+#pragma once
+#include "counter.h"
+#include "module.h"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace dark {
+
+enum class ProfileFormat { Json, Csv };
+
+namespace details {
+
+	/* The time stamp counter where there is one, else nanoseconds. */
+	inline std::uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		return __rdtsc();
+#else
+		using _Clock_t = std::chrono::steady_clock;
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(_Clock_t::now().time_since_epoch()).count();
+#endif
+	}
+
+	inline std::string json_string(const std::string &text) {
+		std::string result = "\"";
+		for (char c: text) {
+			if (c == '"' || c == '\\') result += '\\';
+			if (static_cast<unsigned char>(c) < 0x20) c = ' ';
+			result += c;
+		}
+		return result + '"';
+	}
+
+	/* A CSV field in quotes, with quotes doubled (RFC 4180). */
+	inline std::string csv_string(const std::string &text) {
+		std::string result = "\"";
+		for (char c: text) {
+			if (c == '"') result += '"';
+			result += c;
+		}
+		return result + '"';
+	}
+
+	/* Counts are written in full, times with 6 significant digits. */
+	inline void put_number(std::ostream &out, double value) {
+		if (value >= 0 && value < 0x1p53 && value == static_cast<double>(static_cast<std::uint64_t>(value)))
+			out << static_cast<std::uint64_t>(value);
+		else
+			out << value;
+	}
+
+} // namespace details
+
+/**
+ * @brief Per-module performance counters of a CPU, see CPU::enable_profiling.
+ * Register writes, wire evaluations and work() calls are counted in every
+ * cycle; the time of work() and of each module's sync is sampled once in a
+ * period of cycles, and reported as a mean per call.
+ */
+class Profile {
+public:
+	/* What is measured of one module. */
+	struct Entry {
+		details::EventCounts events;
+		std::uint64_t work_calls   = 0;
+		std::uint64_t work_samples = 0;
+		std::uint64_t work_ticks   = 0;
+		std::uint64_t sync_samples = 0;
+		std::uint64_t sync_ticks   = 0;
+	};
+
+private:
+	using _Clock_t = std::chrono::steady_clock;
+
+	std::string _M_path;
+	ProfileFormat _M_format;
+	unsigned long long _M_period;
+	unsigned long long _M_cycles = 0; // Cycles run since profiling was enabled.
+
+	std::vector<Entry> _M_entries;
+	details::EventCounts _M_outside; // Wires evaluated before work(), by topological evaluation.
+	std::unordered_map<const ModuleBase *, std::string> _M_names;
+
+	std::uint64_t _M_start_ticks;
+	_Clock_t::time_point _M_start_time;
+
+	struct Row {
+		std::string name;
+		std::vector<std::pair<std::string, double>> values;
+	};
+
+	std::vector<Row> _M_rows(const std::vector<ModuleBase *> &modules,
+							 const std::vector<unsigned long long> &gated) const {
+		const auto ticks   = details::ticks() - this->_M_start_ticks;
+		const auto elapsed = std::chrono::duration<double, std::nano>(_Clock_t::now() - this->_M_start_time);
+		const double ns_per_tick = ticks == 0 ? 1.0 : elapsed.count() / static_cast<double>(ticks);
+		auto mean = [ns_per_tick](std::uint64_t ticks, std::uint64_t samples) {
+			return samples == 0 ? 0.0 : static_cast<double>(ticks) / static_cast<double>(samples) * ns_per_tick;
+		};
+
+		std::vector<Row> rows;
+		for (std::size_t m = 0; m < modules.size(); ++m) {
+			const Entry entry = m < this->_M_entries.size() ? this->_M_entries[m] : Entry{};
+			auto iter = this->_M_names.find(modules[m]);
+			auto &row = rows.emplace_back();
+			row.name  = iter != this->_M_names.end() ? iter->second : "module_" + std::to_string(m);
+			const double work_ns = mean(entry.work_ticks, entry.work_samples);
+			const double sync_ns = mean(entry.sync_ticks, entry.sync_samples);
+			row.values = {
+					{"work_ns", work_ns},
+					{"sync_ns", sync_ns},
+					{"work_total_ms", work_ns * static_cast<double>(entry.work_calls) / 1e6},
+					{"sync_total_ms", sync_ns * static_cast<double>(this->_M_cycles) / 1e6},
+					{"work_calls", static_cast<double>(entry.work_calls)},
+					{"register_writes", static_cast<double>(entry.events.register_writes)},
+					{"wire_evaluations", static_cast<double>(entry.events.wire_evaluations)},
+					{"gated_cycles", static_cast<double>(m < gated.size() ? gated[m] : 0)},
+			};
+			CounterList list;
+			modules[m]->counters(list);
+			for (auto &[name, counter]: list)
+				row.values.emplace_back("counter." + name, static_cast<double>(counter->value));
+		}
+		return rows;
+	}
+
+public:
+	/* Time is sampled once in period cycles; 1 samples every cycle. */
+	Profile(std::string path, ProfileFormat format = ProfileFormat::Json, unsigned long long period = 1024)
+		: _M_path(std::move(path)), _M_format(format), _M_period(period == 0 ? 1 : period),
+		  _M_start_ticks(details::ticks()), _M_start_time(_Clock_t::now()) {}
+
+	/* Name a module in the dump. Unnamed ones are called module_<index>. */
+	void name(const ModuleBase *module, std::string name) { this->_M_names[module] = std::move(name); }
+
+	/* Called by the CPU at the start of each cycle. */
+	void begin_cycle(std::size_t modules) {
+		if (this->_M_entries.size() < modules) this->_M_entries.resize(modules);
+		++this->_M_cycles;
+	}
+
+	bool sampled(unsigned long long cycle) const { return cycle % this->_M_period == 0; }
+
+	Entry &entry(std::size_t module) { return this->_M_entries[module]; }
+	const Entry &entry(std::size_t module) const { return this->_M_entries[module]; }
+	details::EventCounts &outside() { return this->_M_outside; }
+	unsigned long long cycles() const { return this->_M_cycles; }
+
+	/**
+	 * @brief Write the counters of the modules to the file, replacing it.
+	 * JSON has one object per module; CSV has one module,metric,value row per value,
+	 * with the module and metric quoted.
+	 * @throw std::runtime_error if the file cannot be written.
+	 */
+	void write(const std::vector<ModuleBase *> &modules, const std::vector<unsigned long long> &gated = {}) const {
+		std::ofstream out(this->_M_path);
+		if (!out) throw std::runtime_error("Profile: cannot open " + this->_M_path);
+		const auto rows = this->_M_rows(modules, gated);
+		if (this->_M_format == ProfileFormat::Csv) {
+			out << "module,metric,value\n";
+			out << ",cycles," << this->_M_cycles << '\n';
+			out << ",wire_evaluations_before_work," << this->_M_outside.wire_evaluations << '\n';
+			for (auto &row: rows)
+				for (auto &[metric, value]: row.values) {
+					out << details::csv_string(row.name) << ',' << details::csv_string(metric) << ',';
+					details::put_number(out, value);
+					out << '\n';
+				}
+		} else {
+			out << "{\n  \"cycles\": " << this->_M_cycles << ",\n  \"period\": " << this->_M_period
+				<< ",\n  \"wire_evaluations_before_work\": " << this->_M_outside.wire_evaluations
+				<< ",\n  \"modules\": [";
+			for (std::size_t r = 0; r < rows.size(); ++r) {
+				out << (r == 0 ? "\n" : ",\n") << "    {\"name\": " << details::json_string(rows[r].name);
+				for (auto &[metric, value]: rows[r].values) {
+					out << ", " << details::json_string(metric) << ": ";
+					details::put_number(out, value);
+				}
+				out << '}';
+			}
+			out << "\n  ]\n}\n";
+		}
+		if (!out) throw std::runtime_error("Profile: cannot write " + this->_M_path);
+	}
+};
+
+} // namespace dark
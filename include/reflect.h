@@ -1,104 +1,197 @@
 #pragma once
 #include <concepts>
+#include <cstddef>
 #include <tuple>
+#include <utility>
 
 namespace dark::reflect {
 
+/* The largest aggregate tuplify can split into members. */
+inline constexpr std::size_t kMaxMembers = 64;
+
 /* A init helper to get the size of a struct. */
 struct init_helper {
 	template<typename _Tp>
 	operator _Tp();
 };
 
-/* A size helper to get the size of a struct. */
-template<typename _Tp>
-	requires std::is_aggregate_v<_Tp>
-inline consteval auto member_size_aux(auto &&...args) -> std::size_t {
-	constexpr std::size_t size = sizeof...(args);
-	constexpr std::size_t maximum = 114;
-	if constexpr (size > maximum) {
-		static_assert(sizeof(_Tp) == 0, "The struct has too many members.");
+namespace details {
+
+	template<std::size_t>
+	using init_at = init_helper;
+
+	/* Whether _Tp can be brace-initialized from _Nm values, i.e. has at least _Nm members. */
+	template<typename _Tp, std::size_t... _Is>
+	consteval bool init_with(std::index_sequence<_Is...>) {
+		return requires { _Tp{init_at<_Is>{}...}; };
 	}
-	else if constexpr (!requires { _Tp{args...}; }) {
-		return size - 1;
+
+	template<typename _Tp, std::size_t _Nm>
+	inline constexpr bool init_with_v = init_with<_Tp>(std::make_index_sequence<_Nm>{});
+
+	/**
+	 * Binary search of the member count in [_Lo, _Hi], knowing _Tp has at
+	 * least _Lo members. This probes log2(kMaxMembers) sizes, where a linear
+	 * search probes every size up to the count (quadratic in initializers).
+	 */
+	template<typename _Tp, std::size_t _Lo, std::size_t _Hi>
+	consteval std::size_t member_search() {
+		if constexpr (_Lo == _Hi) {
+			return _Lo;
+		} else {
+			constexpr std::size_t mid = (_Lo + _Hi + 1) / 2;
+			if constexpr (init_with_v<_Tp, mid>)
+				return member_search<_Tp, mid, _Hi>();
+			else
+				return member_search<_Tp, _Lo, mid - 1>();
+		}
 	}
-	else {
-		return member_size_aux<_Tp>(args..., init_helper{});
+
+	template<typename _Tp>
+	consteval std::size_t member_count() {
+		static_assert(!init_with_v<_Tp, kMaxMembers + 1>, "The struct has too many members.");
+		return member_search<_Tp, 0, kMaxMembers>();
 	}
-}
+
+	/* bind<_Nm>::tie(value) returns a tuple of references to the _Nm members of value. */
+	template<std::size_t _Nm>
+	struct bind;
+
+/* x0, x1, ..., x(N-1): the names of the structured binding of N members. */
+#define DARK_REFLECT_NAMES_1 x0
+#define DARK_REFLECT_NAMES_2 DARK_REFLECT_NAMES_1, x1
+#define DARK_REFLECT_NAMES_3 DARK_REFLECT_NAMES_2, x2
+#define DARK_REFLECT_NAMES_4 DARK_REFLECT_NAMES_3, x3
+#define DARK_REFLECT_NAMES_5 DARK_REFLECT_NAMES_4, x4
+#define DARK_REFLECT_NAMES_6 DARK_REFLECT_NAMES_5, x5
+#define DARK_REFLECT_NAMES_7 DARK_REFLECT_NAMES_6, x6
+#define DARK_REFLECT_NAMES_8 DARK_REFLECT_NAMES_7, x7
+#define DARK_REFLECT_NAMES_9 DARK_REFLECT_NAMES_8, x8
+#define DARK_REFLECT_NAMES_10 DARK_REFLECT_NAMES_9, x9
+#define DARK_REFLECT_NAMES_11 DARK_REFLECT_NAMES_10, x10
+#define DARK_REFLECT_NAMES_12 DARK_REFLECT_NAMES_11, x11
+#define DARK_REFLECT_NAMES_13 DARK_REFLECT_NAMES_12, x12
+#define DARK_REFLECT_NAMES_14 DARK_REFLECT_NAMES_13, x13
+#define DARK_REFLECT_NAMES_15 DARK_REFLECT_NAMES_14, x14
+#define DARK_REFLECT_NAMES_16 DARK_REFLECT_NAMES_15, x15
+#define DARK_REFLECT_NAMES_17 DARK_REFLECT_NAMES_16, x16
+#define DARK_REFLECT_NAMES_18 DARK_REFLECT_NAMES_17, x17
+#define DARK_REFLECT_NAMES_19 DARK_REFLECT_NAMES_18, x18
+#define DARK_REFLECT_NAMES_20 DARK_REFLECT_NAMES_19, x19
+#define DARK_REFLECT_NAMES_21 DARK_REFLECT_NAMES_20, x20
+#define DARK_REFLECT_NAMES_22 DARK_REFLECT_NAMES_21, x21
+#define DARK_REFLECT_NAMES_23 DARK_REFLECT_NAMES_22, x22
+#define DARK_REFLECT_NAMES_24 DARK_REFLECT_NAMES_23, x23
+#define DARK_REFLECT_NAMES_25 DARK_REFLECT_NAMES_24, x24
+#define DARK_REFLECT_NAMES_26 DARK_REFLECT_NAMES_25, x25
+#define DARK_REFLECT_NAMES_27 DARK_REFLECT_NAMES_26, x26
+#define DARK_REFLECT_NAMES_28 DARK_REFLECT_NAMES_27, x27
+#define DARK_REFLECT_NAMES_29 DARK_REFLECT_NAMES_28, x28
+#define DARK_REFLECT_NAMES_30 DARK_REFLECT_NAMES_29, x29
+#define DARK_REFLECT_NAMES_31 DARK_REFLECT_NAMES_30, x30
+#define DARK_REFLECT_NAMES_32 DARK_REFLECT_NAMES_31, x31
+#define DARK_REFLECT_NAMES_33 DARK_REFLECT_NAMES_32, x32
+#define DARK_REFLECT_NAMES_34 DARK_REFLECT_NAMES_33, x33
+#define DARK_REFLECT_NAMES_35 DARK_REFLECT_NAMES_34, x34
+#define DARK_REFLECT_NAMES_36 DARK_REFLECT_NAMES_35, x35
+#define DARK_REFLECT_NAMES_37 DARK_REFLECT_NAMES_36, x36
+#define DARK_REFLECT_NAMES_38 DARK_REFLECT_NAMES_37, x37
+#define DARK_REFLECT_NAMES_39 DARK_REFLECT_NAMES_38, x38
+#define DARK_REFLECT_NAMES_40 DARK_REFLECT_NAMES_39, x39
+#define DARK_REFLECT_NAMES_41 DARK_REFLECT_NAMES_40, x40
+#define DARK_REFLECT_NAMES_42 DARK_REFLECT_NAMES_41, x41
+#define DARK_REFLECT_NAMES_43 DARK_REFLECT_NAMES_42, x42
+#define DARK_REFLECT_NAMES_44 DARK_REFLECT_NAMES_43, x43
+#define DARK_REFLECT_NAMES_45 DARK_REFLECT_NAMES_44, x44
+#define DARK_REFLECT_NAMES_46 DARK_REFLECT_NAMES_45, x45
+#define DARK_REFLECT_NAMES_47 DARK_REFLECT_NAMES_46, x46
+#define DARK_REFLECT_NAMES_48 DARK_REFLECT_NAMES_47, x47
+#define DARK_REFLECT_NAMES_49 DARK_REFLECT_NAMES_48, x48
+#define DARK_REFLECT_NAMES_50 DARK_REFLECT_NAMES_49, x49
+#define DARK_REFLECT_NAMES_51 DARK_REFLECT_NAMES_50, x50
+#define DARK_REFLECT_NAMES_52 DARK_REFLECT_NAMES_51, x51
+#define DARK_REFLECT_NAMES_53 DARK_REFLECT_NAMES_52, x52
+#define DARK_REFLECT_NAMES_54 DARK_REFLECT_NAMES_53, x53
+#define DARK_REFLECT_NAMES_55 DARK_REFLECT_NAMES_54, x54
+#define DARK_REFLECT_NAMES_56 DARK_REFLECT_NAMES_55, x55
+#define DARK_REFLECT_NAMES_57 DARK_REFLECT_NAMES_56, x56
+#define DARK_REFLECT_NAMES_58 DARK_REFLECT_NAMES_57, x57
+#define DARK_REFLECT_NAMES_59 DARK_REFLECT_NAMES_58, x58
+#define DARK_REFLECT_NAMES_60 DARK_REFLECT_NAMES_59, x59
+#define DARK_REFLECT_NAMES_61 DARK_REFLECT_NAMES_60, x60
+#define DARK_REFLECT_NAMES_62 DARK_REFLECT_NAMES_61, x61
+#define DARK_REFLECT_NAMES_63 DARK_REFLECT_NAMES_62, x62
+#define DARK_REFLECT_NAMES_64 DARK_REFLECT_NAMES_63, x63
+
+/* Only the specialization of a used size is instantiated, unlike a chain of if constexpr. */
+#define DARK_REFLECT_BIND(N)                                                                                           \
+	template<>                                                                                                         \
+	struct bind<N> {                                                                                                   \
+		template<typename _Tp>                                                                                         \
+		static auto tie(_Tp &value) {                                                                                  \
+			auto &[DARK_REFLECT_NAMES_##N] = value;                                                                    \
+			return std::forward_as_tuple(DARK_REFLECT_NAMES_##N);                                                      \
+		}                                                                                                              \
+	};
+#define DARK_REFLECT_BIND_DECADE(T)                                                                                    \
+	DARK_REFLECT_BIND(T##0)                                                                                            \
+	DARK_REFLECT_BIND(T##1)                                                                                            \
+	DARK_REFLECT_BIND(T##2)                                                                                            \
+	DARK_REFLECT_BIND(T##3)                                                                                            \
+	DARK_REFLECT_BIND(T##4)                                                                                            \
+	DARK_REFLECT_BIND(T##5)                                                                                            \
+	DARK_REFLECT_BIND(T##6)                                                                                            \
+	DARK_REFLECT_BIND(T##7)                                                                                            \
+	DARK_REFLECT_BIND(T##8)                                                                                            \
+	DARK_REFLECT_BIND(T##9)
+
+	DARK_REFLECT_BIND(1)
+	DARK_REFLECT_BIND(2)
+	DARK_REFLECT_BIND(3)
+	DARK_REFLECT_BIND(4)
+	DARK_REFLECT_BIND(5)
+	DARK_REFLECT_BIND(6)
+	DARK_REFLECT_BIND(7)
+	DARK_REFLECT_BIND(8)
+	DARK_REFLECT_BIND(9)
+	DARK_REFLECT_BIND_DECADE(1)
+	DARK_REFLECT_BIND_DECADE(2)
+	DARK_REFLECT_BIND_DECADE(3)
+	DARK_REFLECT_BIND_DECADE(4)
+	DARK_REFLECT_BIND_DECADE(5)
+	DARK_REFLECT_BIND(60)
+	DARK_REFLECT_BIND(61)
+	DARK_REFLECT_BIND(62)
+	DARK_REFLECT_BIND(63)
+	DARK_REFLECT_BIND(64)
+
+#undef DARK_REFLECT_BIND_DECADE
+#undef DARK_REFLECT_BIND
+
+} // namespace details
+
+/* The member count of an aggregate type without base, computed once per type. */
+template<typename _Tp>
+	requires std::is_aggregate_v<_Tp>
+inline constexpr std::size_t member_count_v = details::member_count<_Tp>();
 
 /* Return the member size for a aggregate type without base.  */
 template<typename _Tp>
 	requires std::is_aggregate_v<_Tp>
-inline consteval auto member_size(_Tp &) -> std::size_t { return member_size_aux<_Tp>(); }
+inline consteval auto member_size(_Tp &) -> std::size_t { return member_count_v<_Tp>; }
 
 template<typename _Tp>
 	requires std::is_aggregate_v<_Tp>
-inline consteval auto member_size() -> std::size_t { return member_size_aux<_Tp>(); }
+inline consteval auto member_size() -> std::size_t { return member_count_v<_Tp>; }
 
 template<typename _Tp>
 	requires std::is_aggregate_v<_Tp>
 auto tuplify(_Tp &value) {
-	constexpr auto size = member_size<_Tp>();
-	if constexpr (size == 1) {
-		auto &[x0] = value;
-		return std::forward_as_tuple(x0);
-	}
-	else if constexpr (size == 2) {
-		auto &[x0, x1] = value;
-		return std::forward_as_tuple(x0, x1);
-	}
-	else if constexpr (size == 3) {
-		auto &[x0, x1, x2] = value;
-		return std::forward_as_tuple(x0, x1, x2);
-	}
-	else if constexpr (size == 4) {
-		auto &[x0, x1, x2, x3] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3);
-	}
-	else if constexpr (size == 5) {
-		auto &[x0, x1, x2, x3, x4] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4);
-	}
-	else if constexpr (size == 6) {
-		auto &[x0, x1, x2, x3, x4, x5] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5);
-	}
-	else if constexpr (size == 7) {
-		auto &[x0, x1, x2, x3, x4, x5, x6] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6);
-	}
-	else if constexpr (size == 8) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7);
-	}
-	else if constexpr (size == 9) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8);
-	}
-	else if constexpr (size == 10) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9);
-	}
-	else if constexpr (size == 11) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10);
-	}
-	else if constexpr (size == 12) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11);
-	}
-	else if constexpr (size == 13) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12);
-	}
-	else if constexpr (size == 14) {
-		auto &[x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13] = value;
-		return std::forward_as_tuple(x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13);
-	}
-	else {
-		static_assert(sizeof(_Tp) == 0, "The struct has too many members.");
-	}
+	constexpr auto size = member_count_v<_Tp>;
+	if constexpr (size == 0)
+		return std::tuple<>{};
+	else
+		return details::bind<size>::tie(value);
 }
 
 } // namespace dark::reflect
@@ -1,6 +1,11 @@
 #pragma once
+#include "arena.h"
 #include "concept.h"
+#include "counter.h"
 #include "debug.h"
+#include "dirty.h"
+#include "storage.h"
+#include "wide.h"
 
 namespace dark {
 
@@ -11,22 +16,68 @@ private:
 				  "Register: _Len must be in range [1, kMaxLength].");
 
 	friend class Visitor;
+	friend struct Probe;
+	friend class SyncPlan;
+	template<std::size_t>
+	friend struct Wire;
 
-	max_size_t _M_old : _Len;
-	max_size_t _M_new : _Len;
+	/* Separate objects, as old is read while new is written. */
+	details::Cell<_Len> _M_old;
+	details::Cell<_Len> _M_new;
+
+	/* Old value slot in a register arena, nullptr if stored inline. */
+	max_size_t *_M_slot;
 
 	[[no_unique_address]]
 	debug::DebugValue<bool, false> _M_assigned;
 
 	void sync() {
 		this->_M_assigned = false;
-		this->_M_old = this->_M_new;
+		if (this->_M_slot == nullptr) this->_M_old = this->_M_new; // Copies whole words.
+	}
+
+	max_size_t _M_read() const {
+		return this->_M_slot == nullptr ? this->_M_old.get() : *this->_M_slot;
+	}
+
+	/* Value written in this cycle, committed at the next sync. */
+	max_size_t _M_pending() const {
+		return this->_M_slot == nullptr ? this->_M_new.get() : this->_M_slot[details::kArenaPageSize];
+	}
+
+	void _M_restore(max_size_t old_value, max_size_t new_value) {
+		this->_M_assigned = false;
+		if (this->_M_slot == nullptr) {
+			this->_M_old.set(old_value);
+			this->_M_new.set(new_value);
+		}
+		else {
+			this->_M_slot[0]                       = old_value & make_mask<_Len>();
+			this->_M_slot[details::kArenaPageSize] = new_value & make_mask<_Len>();
+		}
+	}
+
+	/* Move the storage into an arena slot, or back inline if slot is nullptr. */
+	void _M_bind(max_size_t *slot) {
+		max_size_t old_value = this->_M_read();
+		max_size_t new_value = this->_M_slot == nullptr
+									   ? this->_M_new.get()
+									   : this->_M_slot[details::kArenaPageSize];
+		this->_M_slot = slot;
+		if (slot == nullptr) {
+			this->_M_old.set(old_value);
+			this->_M_new.set(new_value);
+		}
+		else {
+			slot[0]                       = old_value;
+			slot[details::kArenaPageSize] = new_value;
+		}
 	}
 
 public:
 	static constexpr std::size_t _Bit_Len = _Len;
 
-	Register() : _M_old(), _M_new(), _M_assigned() {}
+	Register() : _M_old(), _M_new(), _M_slot(), _M_assigned() {}
 
 	Register(Register &&) = delete;
 	Register(const Register &) = delete;
@@ -37,11 +88,73 @@ public:
 	void operator<=(const _Tp &value) {
 		debug::assert(!this->_M_assigned, "Register is double assigned in this cycle.");
 		this->_M_assigned = true;
-		this->_M_new = static_cast<max_size_t>(value);
+		if (this->_M_slot == nullptr)
+			this->_M_new.set(static_cast<max_size_t>(value));
+		else
+			this->_M_slot[details::kArenaPageSize] = static_cast<max_size_t>(value) & make_mask<_Len>();
+		details::DirtyList::mark(this, [](void *ptr) { static_cast<Register *>(ptr)->sync(); });
+		details::EventCounts::count_write();
+	}
+
+	explicit operator max_size_t() const { return this->_M_read(); }
+	explicit operator bool() const { return this->_M_read(); }
+};
+
+/**
+ * @brief Register wider than max_size_t, holding a Bit<_Len>.
+ * Wide registers are always stored inline, never in a register arena.
+ */
+template<std::size_t _Len>
+	requires(_Len > kMaxLength)
+struct Register<_Len> {
+private:
+	friend class Visitor;
+	friend struct Probe;
+	friend class SyncPlan;
+	template<std::size_t>
+	friend struct Wire;
+
+	Bit<_Len> _M_old;
+	Bit<_Len> _M_new;
+
+	[[no_unique_address]]
+	debug::DebugValue<bool, false> _M_assigned;
+
+	void sync() {
+		this->_M_assigned = false;
+		this->_M_old      = this->_M_new;
+	}
+
+	const Bit<_Len> &_M_read() const { return this->_M_old; }
+	const Bit<_Len> &_M_pending() const { return this->_M_new; }
+
+	void _M_restore(const Bit<_Len> &old_value, const Bit<_Len> &new_value) {
+		this->_M_assigned = false;
+		this->_M_old      = old_value;
+		this->_M_new      = new_value;
+	}
+
+public:
+	static constexpr std::size_t _Bit_Len = _Len;
+
+	Register() : _M_old(), _M_new(), _M_assigned() {}
+
+	Register(Register &&) = delete;
+	Register(const Register &) = delete;
+	Register &operator=(Register &&) = delete;
+	Register &operator=(const Register &rhs) = delete;
+
+	template<concepts::wide_convertible<_Len> _Tp>
+	void operator<=(const _Tp &value) {
+		debug::assert(!this->_M_assigned, "Register is double assigned in this cycle.");
+		this->_M_assigned = true;
+		this->_M_new      = wide_cast<_Len>(value);
+		details::DirtyList::mark(this, [](void *ptr) { static_cast<Register *>(ptr)->sync(); });
+		details::EventCounts::count_write();
 	}
 
-	explicit operator max_size_t() const { return this->_M_old; }
-	explicit operator bool() const { return this->_M_old; }
+	explicit operator Bit<_Len>() const { return this->_M_read(); }
+	explicit operator bool() const { return static_cast<bool>(this->_M_read()); }
 };
 
 } // namespace dark
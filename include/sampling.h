@@ -0,0 +1,158 @@
+#pragma once
+#if !__has_include(<sys/wait.h>)
+#error "sampling.h needs fork() and pipes (POSIX)."
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace dark {
+
+struct SamplingOptions {
+	std::uint64_t warmup   = 0; // Units to fast-forward before the first sample.
+	std::uint64_t interval = 1; // Units to fast-forward between two samples.
+	std::size_t samples    = 1; // Number of sample points.
+	std::size_t jobs       = 0; // Children running at once, 0 for one per hardware thread.
+};
+
+/* Mean of one statistic over the samples, with the half-width of its 95% confidence interval. */
+struct SampleStats {
+	double mean   = 0;
+	double stddev = 0;
+	double error  = 0;
+	std::size_t count = 0;
+};
+
+struct SamplingResult {
+	std::vector<std::vector<double>> samples; // Statistics of each sample point, empty if it failed.
+	std::size_t failed = 0;
+
+	/* Summary of statistic i over the samples which succeeded. */
+	SampleStats summary(std::size_t i) const {
+		SampleStats stats;
+		double sum = 0, square = 0;
+		for (auto &sample: this->samples) {
+			if (i >= sample.size()) continue;
+			sum += sample[i];
+			square += sample[i] * sample[i];
+			++stats.count;
+		}
+		if (stats.count == 0) return stats;
+		const auto n = static_cast<double>(stats.count);
+		stats.mean   = sum / n;
+		if (stats.count > 1) {
+			stats.stddev = std::sqrt(std::max(0.0, (square - sum * sum / n) / (n - 1)));
+			stats.error  = 1.96 * stats.stddev / std::sqrt(n);
+		}
+		return stats;
+	}
+};
+
+namespace details {
+
+	struct SampleChild {
+		pid_t pid;
+		int fd; // Read end of the pipe.
+		std::size_t index;
+	};
+
+	inline bool write_all(int fd, const void *data, std::size_t size) {
+		auto *ptr = static_cast<const char *>(data);
+		while (size != 0) {
+			auto n = ::write(fd, ptr, size);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			ptr += n;
+			size -= static_cast<std::size_t>(n);
+		}
+		return true;
+	}
+
+	/* Read the statistics sent by a child and reap it. Empty if it failed. */
+	inline std::vector<double> collect(const SampleChild &child) {
+		std::vector<char> bytes;
+		char buffer[4096];
+		for (;;) {
+			auto n = ::read(child.fd, buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			bytes.insert(bytes.end(), buffer, buffer + n);
+		}
+		::close(child.fd);
+
+		int status = 0;
+		while (::waitpid(child.pid, &status, 0) < 0 && errno == EINTR) {}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || bytes.size() % sizeof(double) != 0) return {};
+		std::vector<double> values(bytes.size() / sizeof(double));
+		std::copy(bytes.begin(), bytes.end(), reinterpret_cast<char *>(values.data()));
+		return values;
+	}
+
+} // namespace details
+
+/**
+ * @brief SMARTS-style sampled simulation. The parent process fast-forwards
+ * with advance(units), e.g. a functional model, and at each sample point
+ * forks a child, which starts from a copy-on-write copy of the whole state
+ * and runs measure() for a window of the detailed model. The statistics
+ * returned by measure() come back over a pipe, while the parent goes on
+ * to the next point, so up to `jobs` windows run on all cores at once.
+ *
+ * @attention Only the calling thread exists in a child. The state that
+ * measure() uses must not depend on other threads: use a single-threaded
+ * CPU without tracing. Children end with _exit(), so they flush no buffers
+ * and run no destructors; they should report through the statistics only.
+ */
+template<typename _Advance, typename _Measure>
+SamplingResult sample(const SamplingOptions &options, _Advance &&advance, _Measure &&measure) {
+	const auto jobs = options.jobs != 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+
+	SamplingResult result;
+	result.samples.resize(options.samples);
+	std::deque<details::SampleChild> running;
+	auto reap_oldest = [&]() {
+		auto child = running.front();
+		running.pop_front();
+		result.samples[child.index] = details::collect(child);
+		if (result.samples[child.index].empty()) ++result.failed;
+	};
+
+	advance(options.warmup);
+	for (std::size_t i = 0; i < options.samples; ++i) {
+		if (i != 0) advance(options.interval);
+		if (running.size() >= jobs) reap_oldest();
+
+		int fds[2];
+		if (::pipe(fds) != 0) throw std::runtime_error("sample: cannot create a pipe");
+		std::fflush(nullptr); // Do not let the child write buffered output twice.
+		const pid_t pid = ::fork();
+		if (pid < 0) {
+			::close(fds[0]);
+			::close(fds[1]);
+			throw std::runtime_error("sample: cannot fork");
+		}
+		if (pid == 0) {
+			::close(fds[0]);
+			int code = 1;
+			try {
+				const std::vector<double> values = measure();
+				code = details::write_all(fds[1], values.data(), values.size() * sizeof(double)) ? 0 : 1;
+			} catch (...) {}
+			::_exit(code);
+		}
+		::close(fds[1]);
+		running.push_back({pid, fds[0], i});
+	}
+	while (!running.empty()) reap_oldest();
+	return result;
+}
+
+} // namespace dark
@@ -0,0 +1,163 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace dark {
+
+/* Statistics of one worker thread, accumulated over all parallel phases. */
+struct ThreadStats {
+	unsigned long long busy_ns = 0; // Time spent running or looking for tasks.
+	unsigned long long wall_ns = 0; // Time of the phases this worker took part in.
+	unsigned long long tasks   = 0; // Tasks run.
+	unsigned long long steals  = 0; // Tasks taken from another worker.
+
+	double utilization() const {
+		return wall_ns == 0 ? 0.0 : static_cast<double>(busy_ns) / static_cast<double>(wall_ns);
+	}
+};
+
+namespace details {
+
+	/**
+	 * @brief Fisher-Yates shuffle. Unlike std::shuffle, the permutation only
+	 * depends on the engine, so a seed is reproducible across standard libraries.
+	 */
+	template<typename _Iter, typename _Engine>
+	inline void shuffle(_Iter first, _Iter last, _Engine &engine) {
+		for (auto n = last - first; n > 1; --n) {
+			auto pick = static_cast<decltype(n)>(engine() % static_cast<std::uint64_t>(n));
+			std::iter_swap(first + (n - 1), first + pick);
+		}
+	}
+
+	/**
+	 * @brief Work-stealing distribution of a fixed set of tasks.
+	 * Each worker owns a queue of task indices. A worker runs its own queue
+	 * first and then steals from the others. Owner and thieves both take
+	 * tasks from the front with one atomic increment, so no locks are needed.
+	 */
+	class TaskScheduler {
+	private:
+		using _Clock_t = std::chrono::steady_clock;
+
+		struct alignas(64) Queue {
+			std::atomic<std::size_t> head;
+			std::size_t begin;
+			std::size_t end;
+		};
+
+		struct alignas(64) Slot {
+			ThreadStats stats;
+		};
+
+		std::size_t _M_workers;
+		std::vector<std::size_t> _M_tasks;
+		std::unique_ptr<Queue[]> _M_queues;
+		std::unique_ptr<Slot[]> _M_slots;
+
+		template<typename _Fn>
+		std::size_t _M_drain(Queue &queue, _Fn &fn) {
+			std::size_t count = 0;
+			for (std::size_t i; (i = queue.head.fetch_add(1, std::memory_order_relaxed)) < queue.end; ++count)
+				fn(this->_M_tasks[i]);
+			return count;
+		}
+
+	public:
+		explicit TaskScheduler(std::size_t workers)
+			: _M_workers(workers),
+			  _M_queues(std::make_unique<Queue[]>(workers)),
+			  _M_slots(std::make_unique<Slot[]>(workers)) {}
+
+		/* Give task i to worker owner[i]. */
+		void assign(const std::vector<std::size_t> &owner) {
+			std::vector<std::size_t> count(this->_M_workers + 1);
+			for (auto worker: owner) ++count[worker + 1];
+			std::partial_sum(count.begin(), count.end(), count.begin());
+
+			this->_M_tasks.resize(owner.size());
+			for (std::size_t w = 0; w < this->_M_workers; ++w) {
+				this->_M_queues[w].begin = count[w];
+				this->_M_queues[w].end   = count[w + 1];
+			}
+			for (std::size_t i = 0; i < owner.size(); ++i)
+				this->_M_tasks[count[owner[i]]++] = i;
+		}
+
+		/* Split n tasks into contiguous, equally sized queues. */
+		void assign_even(std::size_t n) {
+			std::vector<std::size_t> owner(n);
+			for (std::size_t i = 0; i < n; ++i) owner[i] = i * this->_M_workers / n;
+			this->assign(owner);
+		}
+
+		/**
+		 * @brief Longest-processing-time placement: tasks are given, from the
+		 * most to the least expensive, to the worker with the least load.
+		 */
+		void assign_by_cost(const std::vector<double> &cost) {
+			std::vector<std::size_t> order(cost.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(),
+							 [&](std::size_t a, std::size_t b) { return cost[a] > cost[b]; });
+
+			std::vector<double> load(this->_M_workers);
+			std::vector<std::size_t> owner(cost.size());
+			for (auto task: order) {
+				auto worker = std::min_element(load.begin(), load.end()) - load.begin();
+				owner[task] = static_cast<std::size_t>(worker);
+				load[worker] += cost[task];
+			}
+			this->assign(owner);
+		}
+
+		/* Shuffle the order of tasks inside each queue. */
+		template<typename _Engine>
+		void shuffle(_Engine &engine) {
+			for (std::size_t w = 0; w < this->_M_workers; ++w) {
+				auto first = this->_M_tasks.begin();
+				details::shuffle(first + this->_M_queues[w].begin, first + this->_M_queues[w].end, engine);
+			}
+		}
+
+		/* Refill all queues. Must be called before each phase. */
+		void reset() {
+			for (std::size_t w = 0; w < this->_M_workers; ++w)
+				this->_M_queues[w].head.store(this->_M_queues[w].begin, std::memory_order_relaxed);
+		}
+
+		/* Run fn(task) on tasks of this worker, then on stolen ones. */
+		template<typename _Fn>
+		void execute(std::size_t worker, _Fn &&fn) {
+			auto &stats = this->_M_slots[worker].stats;
+			auto start  = _Clock_t::now();
+
+			stats.tasks += this->_M_drain(this->_M_queues[worker], fn);
+			for (std::size_t k = 1; k < this->_M_workers; ++k) {
+				auto stolen = this->_M_drain(this->_M_queues[(worker + k) % this->_M_workers], fn);
+				stats.tasks += stolen;
+				stats.steals += stolen;
+			}
+
+			auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(_Clock_t::now() - start);
+			stats.busy_ns += static_cast<unsigned long long>(busy.count());
+		}
+
+		/* Add the wall time of a finished phase to every worker. */
+		void add_wall_time(unsigned long long ns) {
+			for (std::size_t w = 0; w < this->_M_workers; ++w)
+				this->_M_slots[w].stats.wall_ns += ns;
+		}
+
+		const ThreadStats &stats(std::size_t worker) const { return this->_M_slots[worker].stats; }
+	};
+
+} // namespace details
+
+} // namespace dark
@@ -0,0 +1,330 @@
+#pragma once
+#include "wide.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * Kernels of wide bit vector operators.
+ * The vector kernels use the widest instruction set enabled at compile time
+ * (AVX-512F, AVX2 or SSE2, e.g. with -march=native). Define DARK_NO_SIMD,
+ * or build for another architecture, to use the scalar kernels only.
+ */
+#if !defined(DARK_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64)) && defined(__SSE2__)
+#define DARK_SIMD 1
+#include <immintrin.h>
+#else
+#define DARK_SIMD 0
+#endif
+
+namespace dark::details {
+
+/* Portable kernels, also used in constant evaluation. */
+namespace scalar {
+
+	template<std::size_t _Words, typename _Fn>
+	constexpr void map(word_t *out, const word_t *lhs, const word_t *rhs, _Fn fn) {
+		for (std::size_t i = 0; i < _Words; ++i) out[i] = fn(lhs[i], rhs[i]);
+	}
+
+	template<std::size_t _Words>
+	constexpr void bit_and(word_t *out, const word_t *lhs, const word_t *rhs) {
+		map<_Words>(out, lhs, rhs, [](word_t a, word_t b) { return a & b; });
+	}
+
+	template<std::size_t _Words>
+	constexpr void bit_or(word_t *out, const word_t *lhs, const word_t *rhs) {
+		map<_Words>(out, lhs, rhs, [](word_t a, word_t b) { return a | b; });
+	}
+
+	template<std::size_t _Words>
+	constexpr void bit_xor(word_t *out, const word_t *lhs, const word_t *rhs) {
+		map<_Words>(out, lhs, rhs, [](word_t a, word_t b) { return a ^ b; });
+	}
+
+	template<std::size_t _Words>
+	constexpr void bit_not(word_t *out, const word_t *value) {
+		for (std::size_t i = 0; i < _Words; ++i) out[i] = ~value[i];
+	}
+
+	template<std::size_t _Words>
+	constexpr bool equal(const word_t *lhs, const word_t *rhs) {
+		word_t diff = 0;
+		for (std::size_t i = 0; i < _Words; ++i) diff |= lhs[i] ^ rhs[i];
+		return diff == 0;
+	}
+
+	/* Index of the first lane equal to key, or count. */
+	inline std::size_t find_lane(const std::uint32_t *lanes, std::size_t count, std::uint32_t key) {
+		for (std::size_t i = 0; i < count; ++i)
+			if (lanes[i] == key) return i;
+		return count;
+	}
+
+	template<std::size_t _Words>
+	constexpr void add(word_t *out, const word_t *lhs, const word_t *rhs, word_t carry) {
+		for (std::size_t i = 0; i < _Words; ++i) {
+			const auto sum = lhs[i] + rhs[i];
+			const auto res = sum + carry;
+			carry          = (sum < lhs[i]) | (res < sum);
+			out[i]         = res;
+		}
+	}
+
+	/* Shift left by count < _Words * 64 bits, as funnel shifts of adjacent words. */
+	template<std::size_t _Words>
+	constexpr void shift_left(word_t *out, const word_t *value, std::size_t count) {
+		const auto skip = count / kWordBits;
+		const auto bits = count % kWordBits;
+		for (std::size_t i = _Words; i-- > 0;) {
+			word_t word = i >= skip ? value[i - skip] << bits : 0;
+			if (bits != 0 && i > skip) word |= value[i - skip - 1] >> (kWordBits - bits);
+			out[i] = word;
+		}
+	}
+
+	/* Logical shift right by count < _Words * 64 bits. */
+	template<std::size_t _Words>
+	constexpr void shift_right(word_t *out, const word_t *value, std::size_t count) {
+		const auto skip = count / kWordBits;
+		const auto bits = count % kWordBits;
+		for (std::size_t i = 0; i < _Words; ++i) {
+			word_t word = i + skip < _Words ? value[i + skip] >> bits : 0;
+			if (bits != 0 && i + skip + 1 < _Words) word |= value[i + skip + 1] << (kWordBits - bits);
+			out[i] = word;
+		}
+	}
+
+} // namespace scalar
+
+#if DARK_SIMD
+/**
+ * Vector kernels. They process the widest vectors first and finish the
+ * remaining words with narrower ones.
+ */
+namespace simd {
+
+	enum class Op { And, Or, Xor };
+
+#if defined(__AVX512F__)
+	inline __m512i apply(Op op, __m512i a, __m512i b) {
+		switch (op) {
+			case Op::And: return _mm512_and_si512(a, b);
+			case Op::Or: return _mm512_or_si512(a, b);
+			default: return _mm512_xor_si512(a, b);
+		}
+	}
+#endif
+#if defined(__AVX2__)
+	inline __m256i apply(Op op, __m256i a, __m256i b) {
+		switch (op) {
+			case Op::And: return _mm256_and_si256(a, b);
+			case Op::Or: return _mm256_or_si256(a, b);
+			default: return _mm256_xor_si256(a, b);
+		}
+	}
+#endif
+	inline __m128i apply(Op op, __m128i a, __m128i b) {
+		switch (op) {
+			case Op::And: return _mm_and_si128(a, b);
+			case Op::Or: return _mm_or_si128(a, b);
+			default: return _mm_xor_si128(a, b);
+		}
+	}
+
+	template<std::size_t _Words, Op _Op>
+	inline void bitwise(word_t *out, const word_t *lhs, const word_t *rhs) {
+		std::size_t i = 0;
+#if defined(__AVX512F__)
+		for (; i + 8 <= _Words; i += 8)
+			_mm512_storeu_si512(out + i, apply(_Op, _mm512_loadu_si512(lhs + i), _mm512_loadu_si512(rhs + i)));
+#endif
+#if defined(__AVX2__)
+		for (; i + 4 <= _Words; i += 4) {
+			auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs + i));
+			auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), apply(_Op, a, b));
+		}
+#endif
+		for (; i + 2 <= _Words; i += 2) {
+			auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs + i));
+			auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), apply(_Op, a, b));
+		}
+		if (i < _Words) {
+			switch (_Op) {
+				case Op::And: out[i] = lhs[i] & rhs[i]; break;
+				case Op::Or: out[i] = lhs[i] | rhs[i]; break;
+				default: out[i] = lhs[i] ^ rhs[i]; break;
+			}
+		}
+	}
+
+	template<std::size_t _Words>
+	inline void bit_and(word_t *out, const word_t *lhs, const word_t *rhs) {
+		bitwise<_Words, Op::And>(out, lhs, rhs);
+	}
+
+	template<std::size_t _Words>
+	inline void bit_or(word_t *out, const word_t *lhs, const word_t *rhs) {
+		bitwise<_Words, Op::Or>(out, lhs, rhs);
+	}
+
+	template<std::size_t _Words>
+	inline void bit_xor(word_t *out, const word_t *lhs, const word_t *rhs) {
+		bitwise<_Words, Op::Xor>(out, lhs, rhs);
+	}
+
+	template<std::size_t _Words>
+	inline bool equal(const word_t *lhs, const word_t *rhs) {
+		std::size_t i = 0;
+#if defined(__AVX512F__)
+		for (; i + 8 <= _Words; i += 8)
+			if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(lhs + i), _mm512_loadu_si512(rhs + i)) != 0)
+				return false;
+#endif
+#if defined(__AVX2__)
+		for (; i + 4 <= _Words; i += 4) {
+			auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs + i));
+			auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs + i));
+			if (!_mm256_testz_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, b))) return false;
+		}
+#endif
+		for (; i + 2 <= _Words; i += 2) {
+			auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs + i));
+			auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF) return false;
+		}
+		return i == _Words || lhs[i] == rhs[i];
+	}
+
+	/**
+	 * Compare 16, 8 or 4 lanes at a time, e.g. all the tags of a cache set.
+	 * The masks of up to 64 lanes are merged before the first branch, as
+	 * an early exit at a random lane would be mispredicted.
+	 */
+	inline std::size_t find_lane(const std::uint32_t *lanes, std::size_t count, std::uint32_t key) {
+		for (std::size_t base = 0; base < count; base += 64, lanes += 64) {
+			const auto block   = std::min<std::size_t>(count - base, 64);
+			std::uint64_t mask = 0;
+			std::size_t i      = 0;
+#if defined(__AVX512F__)
+			const auto key16 = _mm512_set1_epi32(static_cast<int>(key));
+			for (; i + 16 <= block; i += 16)
+				mask |= std::uint64_t{_mm512_cmpeq_epi32_mask(_mm512_loadu_si512(lanes + i), key16)} << i;
+#endif
+#if defined(__AVX2__)
+			const auto key8 = _mm256_set1_epi32(static_cast<int>(key));
+			for (; i + 8 <= block; i += 8) {
+				const auto equal = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes + i)), key8);
+				mask |= std::uint64_t(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)))) << i;
+			}
+#endif
+			const auto key4 = _mm_set1_epi32(static_cast<int>(key));
+			for (; i + 4 <= block; i += 4) {
+				const auto equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + i)), key4);
+				mask |= std::uint64_t(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(equal)))) << i;
+			}
+			for (; i < block; ++i) mask |= std::uint64_t{lanes[i] == key} << i;
+			if (mask != 0) return base + std::countr_zero(mask);
+		}
+		return count;
+	}
+
+	/**
+	 * Compilers vectorize the scalar not, and compile the scalar carry chain
+	 * to add-with-carry instructions, so these are not worth hand-written
+	 * vector code. Shifts move bits across lanes and stay scalar too.
+	 */
+	using scalar::add;
+	using scalar::bit_not;
+	using scalar::shift_left;
+	using scalar::shift_right;
+
+} // namespace simd
+
+namespace kernel = simd;
+#else
+namespace kernel = scalar;
+#endif
+
+/* Below this many words, the scalar kernels are as fast as the vector ones. */
+inline constexpr std::size_t kVectorMinWords = 4;
+
+/* Run the vector kernel at runtime, and the scalar one in constant evaluation. */
+#define DARK_WIDE_KERNEL(name, ...)                                                                \
+	(std::is_constant_evaluated() || _Words < kVectorMinWords                                     \
+			 ? scalar::name<_Words>(__VA_ARGS__)                                                  \
+			 : kernel::name<_Words>(__VA_ARGS__))
+
+template<std::size_t _Len>
+constexpr auto wide_and(const Bit<_Len> &lhs, const Bit<_Len> &rhs) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(bit_and, out.data(), lhs.words().data(), rhs.words().data());
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr auto wide_or(const Bit<_Len> &lhs, const Bit<_Len> &rhs) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(bit_or, out.data(), lhs.words().data(), rhs.words().data());
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr auto wide_xor(const Bit<_Len> &lhs, const Bit<_Len> &rhs) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(bit_xor, out.data(), lhs.words().data(), rhs.words().data());
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr auto wide_not(const Bit<_Len> &value) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(bit_not, out.data(), value.words().data());
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr bool wide_equal(const Bit<_Len> &lhs, const Bit<_Len> &rhs) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	return DARK_WIDE_KERNEL(equal, lhs.words().data(), rhs.words().data());
+}
+
+template<std::size_t _Len>
+constexpr auto wide_add(const Bit<_Len> &lhs, const Bit<_Len> &rhs, word_t carry) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(add, out.data(), lhs.words().data(), rhs.words().data(), carry);
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr auto wide_shift_left(const Bit<_Len> &value, std::size_t count) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(shift_left, out.data(), value.words().data(), count);
+	return Bit<_Len>(out);
+}
+
+template<std::size_t _Len>
+constexpr auto wide_shift_right(const Bit<_Len> &value, std::size_t count) {
+	constexpr auto _Words = Bit<_Len>::_Words;
+	typename Bit<_Len>::_Array_t out;
+	DARK_WIDE_KERNEL(shift_right, out.data(), value.words().data(), count);
+	return Bit<_Len>(out);
+}
+
+#undef DARK_WIDE_KERNEL
+
+/* Index of the first of count lanes equal to key, or count. */
+inline std::size_t find_lane(const std::uint32_t *lanes, std::size_t count, std::uint32_t key) {
+	return kernel::find_lane(lanes, count, key);
+}
+
+} // namespace dark::details
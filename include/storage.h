@@ -0,0 +1,28 @@
+#pragma once
+#include "concept.h"
+
+namespace dark::details {
+
+/**
+ * @brief Storage of a narrow register or wire value.
+ * By default, the value is a bitfield of _Len bits, which keeps registers
+ * and wires small. Define DARK_NATIVE_STORAGE to store a whole max_size_t
+ * instead: reads become plain loads, and the value is masked once when it
+ * is written.
+ */
+template<std::size_t _Len>
+struct Cell {
+#ifdef DARK_NATIVE_STORAGE
+	max_size_t _M_value;
+
+	max_size_t get() const { return this->_M_value; }
+	void set(max_size_t value) { this->_M_value = value & make_mask<_Len>(); }
+#else
+	max_size_t _M_value : _Len;
+
+	max_size_t get() const { return this->_M_value; }
+	void set(max_size_t value) { this->_M_value = value; }
+#endif
+};
+
+} // namespace dark::details
@@ -1,6 +1,7 @@
 #pragma once
 #include "bit.h"
 #include "bit_impl.h"
+#include "wide.h"
 #include "operator.h"
 #include "register.h"
 #include "synchronize.h"
@@ -8,15 +9,6 @@
 #include "module.h"
 #include "cpu.h"
 
-namespace dark {
-
-template <std::size_t _Len>
-auto Wire<_Len>::operator = (const Register <_Len> &reg) -> Wire &{
-	return this->assign([&]() -> auto & { return reg; }), *this;
-}
-
-} // namespace dark
-
 using dark::Bit;
 using dark::sign_extend;
 using dark::zero_extend;
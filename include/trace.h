@@ -0,0 +1,282 @@
+#pragma once
+#include "module.h"
+#include "trace_format.h"
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+namespace details {
+
+	/**
+	 * @brief Runs a trace writer on a background thread. Chunks are handed
+	 * over in order, and written chunks are given back to be reused.
+	 */
+	class TraceThread {
+	private:
+		std::unique_ptr<TraceWriter> _M_writer;
+
+		std::mutex _M_mutex;
+		std::condition_variable _M_ready;
+		std::vector<TraceChunk> _M_pending;
+		std::vector<TraceChunk> _M_free;
+		bool _M_closing = false;
+		std::thread _M_thread;
+
+		void _M_run() {
+			std::vector<TraceChunk> work;
+			for (bool closing = false; !closing;) {
+				{
+					std::unique_lock lock(this->_M_mutex);
+					this->_M_ready.wait(lock, [this] { return this->_M_closing || !this->_M_pending.empty(); });
+					work.swap(this->_M_pending);
+					closing = this->_M_closing;
+				}
+				for (auto &chunk: work) {
+					this->_M_writer->write(chunk);
+					chunk.clear();
+				}
+				std::lock_guard lock(this->_M_mutex);
+				for (auto &chunk: work) this->_M_free.push_back(std::move(chunk));
+				work.clear();
+			}
+			this->_M_writer->end();
+		}
+
+	public:
+		explicit TraceThread(std::unique_ptr<TraceWriter> writer) : _M_writer(std::move(writer)) {}
+		TraceThread(const TraceThread &) = delete;
+		TraceThread &operator=(const TraceThread &) = delete;
+
+		/* Write the pending chunks and finish the file. */
+		~TraceThread() {
+			if (!this->_M_thread.joinable()) return;
+			{
+				std::lock_guard lock(this->_M_mutex);
+				this->_M_closing = true;
+			}
+			this->_M_ready.notify_one();
+			this->_M_thread.join();
+		}
+
+		void start(const std::vector<TraceSignal> &signals) {
+			this->_M_writer->begin(signals);
+			this->_M_thread = std::thread(&TraceThread::_M_run, this);
+		}
+
+		/* Hand a chunk over to the background thread, and get an empty one back. */
+		void submit(TraceChunk &chunk) {
+			TraceChunk next;
+			{
+				std::lock_guard lock(this->_M_mutex);
+				this->_M_pending.push_back(std::move(chunk));
+				if (!this->_M_free.empty()) {
+					next = std::move(this->_M_free.back());
+					this->_M_free.pop_back();
+				}
+			}
+			this->_M_ready.notify_one();
+			chunk = std::move(next);
+		}
+	};
+
+	inline std::unique_ptr<TraceWriter> make_trace_writer(const std::string &path, TraceFormat format) {
+		switch (format) {
+			case TraceFormat::Vcd: return std::make_unique<VcdWriter>(path);
+			case TraceFormat::Binary: return std::make_unique<BinaryTraceWriter>(path, false);
+			default: return std::make_unique<BinaryTraceWriter>(path, true);
+		}
+	}
+
+} // namespace details
+
+/**
+ * @brief Trace of all registers and wires of the modules, as VCD text or
+ * in the binary trace format (see trace_format.h).
+ * Each cycle, the registers written in the cycle (from the dirty lists of
+ * the CPU) and all wires are compared with their last values, and only the
+ * changes are buffered. Buffers are encoded and written to the file
+ * on a background thread. Signals are found by probing the modules, so
+ * modules with an opaque probe() are not traced.
+ */
+class Trace {
+private:
+	struct Signal {
+		Probe probe;
+		std::size_t offset; // First word of the value in _M_values.
+	};
+
+	/* Buffered words before a chunk is handed to the writer. */
+	static constexpr std::size_t kChunkWords = std::size_t(1) << 16;
+
+	details::TraceThread _M_writer;
+	std::vector<Signal> _M_signals;
+	ProbeList _M_wires; // Wires among the signals.
+	std::vector<std::size_t> _M_wire_signals;                    // Their indices, ascending.
+	std::unordered_map<const void *, std::size_t> _M_registers; // Signal index of each register.
+	std::vector<std::size_t> _M_written; // Register signals written in this cycle.
+	std::vector<std::size_t> _M_changed; // Signals to compare in this cycle, ascending.
+	bool _M_rescan = true; // Whether all registers are compared at the next sample.
+	unsigned _M_backoff = 0; // Cycles left without collecting, after a cycle with many writes.
+
+	/* Cycles without collecting after a cycle writing more than a quarter of the registers. */
+	static constexpr unsigned kBackoff = 64;
+	std::vector<details::word_t> _M_values;  // Last value of each signal.
+	std::vector<details::word_t> _M_scratch; // Value of this cycle.
+	details::TraceChunk _M_chunk;
+	bool _M_started = false;
+
+	struct Names {
+		std::string scope;
+		std::vector<std::string> signals;
+	};
+	std::unordered_map<const ModuleBase *, Names> _M_names;
+
+	void _M_start(const std::vector<ModuleBase *> &modules) {
+		std::vector<details::TraceSignal> signals;
+		std::size_t max_words = 0;
+		for (std::size_t m = 0; m < modules.size(); ++m) {
+			ProbeList list;
+			modules[m]->probe(list);
+			auto iter  = this->_M_names.find(modules[m]);
+			auto scope = iter != this->_M_names.end() ? iter->second.scope : "module_" + std::to_string(m);
+			for (std::size_t i = 0; i < list.size(); ++i) {
+				auto &probe = list[i];
+				if (!probe.connected()) continue;
+				const bool is_register = probe.kind == Probe::Kind::Register;
+				std::string name;
+				if (iter != this->_M_names.end() && i < iter->second.signals.size())
+					name = iter->second.signals[i];
+				else
+					name = (is_register ? "reg_" : "wire_") + std::to_string(i);
+				signals.push_back({scope, std::move(name), probe.width, is_register});
+				if (is_register) {
+					this->_M_registers.emplace(probe.object, this->_M_signals.size());
+				} else {
+					this->_M_wires.push_back(probe);
+					this->_M_wire_signals.push_back(this->_M_signals.size());
+				}
+				this->_M_signals.push_back({probe, this->_M_values.size()});
+				this->_M_values.resize(this->_M_values.size() + probe.words());
+				max_words = std::max(max_words, probe.words());
+			}
+		}
+		this->_M_scratch.resize(max_words);
+		this->_M_chunk.reserve(kChunkWords);
+		this->_M_writer.start(signals);
+	}
+
+	void _M_record(std::size_t index, const details::word_t *value, std::size_t words) {
+		this->_M_chunk.push_back(index);
+		this->_M_chunk.insert(this->_M_chunk.end(), value, value + words);
+	}
+
+public:
+	/* @throw std::runtime_error if the file cannot be opened. */
+	explicit Trace(const std::string &path, TraceFormat format = TraceFormat::Vcd)
+		: _M_writer(details::make_trace_writer(path, format)) {}
+
+	/**
+	 * @brief Name the scope of a module, and optionally its signals, in the
+	 * order they are probed. Unnamed ones are called module_<index>,
+	 * reg_<index> and wire_<index>. Names are used from the first sample on.
+	 */
+	void name(const ModuleBase *module, std::string scope, std::vector<std::string> signals = {}) {
+		this->_M_names[module] = {std::move(scope), std::move(signals)};
+	}
+
+	/**
+	 * @brief Note the registers written in this cycle, from the dirty lists,
+	 * before the sync phase empties them. Only those are compared at the next
+	 * sample. Writes the lists did not see (e.g. a register restored from a
+	 * checkpoint) need a rescan().
+	 */
+	void collect(const std::vector<details::DirtyList> &lists) {
+		if (!this->collecting() || this->_M_rescan) return;
+		std::size_t entries = 0;
+		for (auto &list: lists) entries += list.size();
+		if (entries > this->_M_registers.size() / 4) { // Comparing all is cheaper.
+			this->_M_backoff = kBackoff;
+			return this->rescan();
+		}
+		for (auto &list: lists)
+			list.visit([this](const void *object) {
+				auto iter = this->_M_registers.find(object);
+				if (iter != this->_M_registers.end()) this->_M_written.push_back(iter->second);
+			});
+	}
+
+	/* Compare all registers at the next sample. */
+	void rescan() { this->_M_rescan = true; }
+
+	/* Whether the CPU should fill its dirty lists for collect() in this cycle. */
+	bool collecting() const { return this->_M_started && this->_M_backoff == 0; }
+
+	/**
+	 * @brief Record the values of this time. The signals are collected from
+	 * the modules at the first sample, whose values are all dumped.
+	 * Wires are evaluated on the committed registers, and then forget their
+	 * value again, so that the next cycle sees the same wires as without
+	 * tracing (e.g. wires driven by a testbench are evaluated again).
+	 */
+	void sample(const std::vector<ModuleBase *> &modules, unsigned long long time) {
+		const bool first = !this->_M_started;
+		if (first) {
+			this->_M_start(modules);
+			this->_M_started = true;
+		}
+
+		/* The written registers and the wires, in ascending order as the format needs. */
+		auto &changed = this->_M_changed;
+		changed.clear();
+		if (this->_M_rescan) {
+			for (std::size_t i = 0; i < this->_M_signals.size(); ++i) changed.push_back(i);
+		} else {
+			std::sort(this->_M_written.begin(), this->_M_written.end());
+			std::merge(this->_M_written.begin(), this->_M_written.end(), this->_M_wire_signals.begin(),
+					   this->_M_wire_signals.end(), std::back_inserter(changed));
+		}
+		this->_M_written.clear();
+		if (this->_M_backoff != 0) --this->_M_backoff;
+		this->_M_rescan = this->_M_backoff != 0; // The next cycle is not collected.
+
+		auto *dirty = std::exchange(details::DirtyList::current, nullptr);
+		bool stamped = false;
+		auto *scratch = this->_M_scratch.data();
+		for (auto i: changed) {
+			auto &[probe, offset] = this->_M_signals[i];
+			const auto words      = probe.words();
+			auto *last            = this->_M_values.data() + offset;
+			probe.load(scratch);
+			if (!first && std::equal(scratch, scratch + words, last)) continue;
+			std::copy(scratch, scratch + words, last);
+			if (!stamped) {
+				this->_M_chunk.push_back(details::kTimeTag);
+				this->_M_chunk.push_back(time);
+				stamped = true;
+			}
+			this->_M_record(i, last, words);
+		}
+		for (auto &wire: this->_M_wires) wire.sync();
+		details::DirtyList::current = dirty;
+
+		if (this->_M_chunk.size() >= kChunkWords) this->_M_writer.submit(this->_M_chunk);
+	}
+
+	/* Hand the buffered changes to the writer. The file is complete once the trace is destroyed. */
+	void flush() {
+		if (!this->_M_chunk.empty()) this->_M_writer.submit(this->_M_chunk);
+	}
+
+	~Trace() { this->flush(); }
+};
+
+} // namespace dark
@@ -0,0 +1,352 @@
+#pragma once
+#include "compress.h"
+#include "wide.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace dark {
+
+/* File format of CPU::enable_trace. */
+enum class TraceFormat : unsigned char {
+	Vcd,        // Value Change Dump text, for waveform viewers.
+	Binary,     // Delta-encoded blocks, see BinaryTraceWriter.
+	Compressed, // Binary, with each block compressed.
+};
+
+namespace details {
+
+	struct TraceSignal {
+		std::string scope;
+		std::string name;
+		std::size_t width;
+		bool is_register;
+
+		std::size_t words() const { return (this->width + kWordBits - 1) / kWordBits; }
+	};
+
+	/**
+	 * Records of value changes, in the order of time. A time record is kTimeTag
+	 * followed by the time, and a change record is the signal index followed by
+	 * its value in words. The changes of one time are in ascending index order.
+	 */
+	using TraceChunk = std::vector<word_t>;
+
+	inline constexpr word_t kTimeTag = ~word_t(0);
+
+	/* Receives the chunks of a trace in order, on one thread. */
+	struct TraceWriter {
+		virtual void begin(const std::vector<TraceSignal> &signals) = 0;
+		virtual void write(const TraceChunk &chunk) = 0;
+		virtual void end() = 0;
+		virtual ~TraceWriter() = default;
+	};
+
+	inline std::FILE *open_file(const std::string &path, const char *mode) {
+		auto *file = std::fopen(path.c_str(), mode);
+		if (file == nullptr) throw std::runtime_error("Cannot open trace file: " + path);
+		return file;
+	}
+
+	/* Formats chunks as VCD text. */
+	class VcdWriter : public TraceWriter {
+	private:
+		std::FILE *_M_file;
+		std::vector<std::size_t> _M_widths; // Width of each signal.
+		std::vector<std::string> _M_codes;  // Identifier code of each signal.
+		std::string _M_text;
+
+		void _M_flush() {
+			std::fwrite(this->_M_text.data(), 1, this->_M_text.size(), this->_M_file);
+			this->_M_text.clear();
+		}
+
+	public:
+		/* Identifier codes are base-94 numbers of the printable characters. */
+		static std::string code(std::size_t index) {
+			std::string result;
+			do {
+				result += static_cast<char>('!' + index % 94);
+				index /= 94;
+			} while (index != 0);
+			return result;
+		}
+
+		explicit VcdWriter(const std::string &path) : _M_file(open_file(path, "w")) {}
+		VcdWriter(const VcdWriter &) = delete;
+		VcdWriter &operator=(const VcdWriter &) = delete;
+		~VcdWriter() override { std::fclose(this->_M_file); }
+
+		void begin(const std::vector<TraceSignal> &signals) override {
+			auto &text = this->_M_text;
+			text += "$version dark RISC-V simulator $end\n$timescale 1ns $end\n";
+			for (std::size_t i = 0; i < signals.size(); ++i) {
+				auto &signal = signals[i];
+				if (i == 0 || signal.scope != signals[i - 1].scope) {
+					if (i != 0) text += "$upscope $end\n";
+					text += "$scope module " + signal.scope + " $end\n";
+				}
+				this->_M_widths.push_back(signal.width);
+				this->_M_codes.push_back(code(i));
+				text += "$var " + std::string(signal.is_register ? "reg " : "wire ") + std::to_string(signal.width) +
+						' ' + this->_M_codes.back() + ' ' + signal.name + " $end\n";
+			}
+			if (!signals.empty()) text += "$upscope $end\n";
+			text += "$enddefinitions $end\n";
+			this->_M_flush();
+		}
+
+		void write(const TraceChunk &chunk) override {
+			auto &text = this->_M_text;
+			for (std::size_t i = 0; i < chunk.size();) {
+				if (chunk[i] == kTimeTag) {
+					text += '#';
+					text += std::to_string(chunk[i + 1]);
+					text += '\n';
+					i += 2;
+					continue;
+				}
+				const auto index = static_cast<std::size_t>(chunk[i++]);
+				const auto width = this->_M_widths[index];
+				if (width == 1) {
+					text += static_cast<char>('0' + (chunk[i] & 1));
+				}
+				else {
+					/* Binary digits, without leading zeros. */
+					text += 'b';
+					auto bit = width;
+					while (bit > 1 && ((chunk[i + (bit - 1) / kWordBits] >> ((bit - 1) % kWordBits)) & 1) == 0)
+						--bit;
+					while (bit-- > 0)
+						text += static_cast<char>('0' + ((chunk[i + bit / kWordBits] >> (bit % kWordBits)) & 1));
+					text += ' ';
+				}
+				text += this->_M_codes[index];
+				text += '\n';
+				i += (width + kWordBits - 1) / kWordBits;
+			}
+			this->_M_flush();
+		}
+
+		void end() override { std::fflush(this->_M_file); }
+	};
+
+	/**
+	 * Binary trace file layout. Integers are little-endian.
+	 *
+	 *   header:  "DKTRACE" 0, u32 version, u32 signal count, then per signal
+	 *            u32 width, u8 is_register, u16 + scope, u16 + name.
+	 *   block:   u64 first time, u64 last time, u32 raw size, u32 stored size,
+	 *            u32 flags (bit 0: compressed), then the stored bytes.
+	 *   index:   "DKINDEX" 0, u64 block count, per block u64 first time,
+	 *            u64 last time, u64 file offset; then u64 offset of the index
+	 *            and "DKTREND" 0 at the very end of the file.
+	 *
+	 * The raw bytes of a block start with a key frame: every value, as it was
+	 * before the first time of the block. Then, per time, come the time minus
+	 * the previous one, the changes and a 0. A change is the index gap to the
+	 * previous change plus 1, and each word as the zigzag of its difference to
+	 * the last value. All numbers are LEB128 varints. Blocks are thus decoded
+	 * on their own, and a reader seeks to a time through the index. The index
+	 * is missing if the writer did not finish; readers then scan the blocks.
+	 */
+	namespace trace_file {
+
+		inline constexpr char kMagic[8]      = "DKTRACE";
+		inline constexpr char kIndexMagic[8] = "DKINDEX";
+		inline constexpr char kEndMagic[8]   = "DKTREND";
+		inline constexpr std::uint32_t kVersion    = 1;
+		inline constexpr std::uint32_t kCompressed = 1;
+
+		inline constexpr std::size_t kBlockHeaderSize = 28;
+		inline constexpr std::size_t kTrailerSize     = 16;
+		inline constexpr std::size_t kIndexEntrySize  = 24; // first, last and offset of a block.
+
+		/* Raw bytes of a block before it is written. */
+		inline constexpr std::size_t kBlockBytes = std::size_t(1) << 16;
+
+		struct BlockInfo {
+			std::uint64_t first;
+			std::uint64_t last;
+			std::uint64_t offset;
+		};
+
+		template<typename _Int>
+		inline void put(std::vector<std::uint8_t> &out, _Int value) {
+			for (std::size_t i = 0; i < sizeof(_Int); ++i)
+				out.push_back(static_cast<std::uint8_t>(static_cast<std::uint64_t>(value) >> (8 * i)));
+		}
+
+		template<typename _Int>
+		inline _Int get(const std::uint8_t *data) {
+			std::uint64_t value = 0;
+			for (std::size_t i = 0; i < sizeof(_Int); ++i) value |= std::uint64_t(data[i]) << (8 * i);
+			return static_cast<_Int>(value);
+		}
+
+		inline void put_varint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+			for (; value >= 0x80; value >>= 7) out.push_back(static_cast<std::uint8_t>(value | 0x80));
+			out.push_back(static_cast<std::uint8_t>(value));
+		}
+
+		/* Read a varint at pos, or throw if it runs past size. */
+		inline std::uint64_t get_varint(const std::uint8_t *data, std::size_t size, std::size_t &pos) {
+			std::uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				if (pos == size) break;
+				const auto byte = data[pos++];
+				value |= std::uint64_t(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0) return value;
+			}
+			throw std::runtime_error("Corrupt trace block.");
+		}
+
+		inline std::uint64_t zigzag(std::uint64_t delta) {
+			return (delta << 1) ^ (0 - (delta >> 63));
+		}
+
+		inline std::uint64_t unzigzag(std::uint64_t value) {
+			return (value >> 1) ^ (0 - (value & 1));
+		}
+
+	} // namespace trace_file
+
+	/* Encodes chunks in the binary trace format. */
+	class BinaryTraceWriter : public TraceWriter {
+	private:
+		std::FILE *_M_file;
+		bool _M_compress;
+		std::uint64_t _M_position = 0; // Bytes written so far.
+
+		std::vector<std::size_t> _M_words;  // Words of each signal.
+		std::vector<std::size_t> _M_offset; // First word of each signal in _M_values.
+		std::vector<word_t> _M_values;      // Values after the last change.
+
+		std::vector<std::uint8_t> _M_block;
+		std::vector<std::uint8_t> _M_packed;
+		std::vector<trace_file::BlockInfo> _M_index;
+		std::uint64_t _M_first = 0;
+		std::uint64_t _M_last  = 0;
+		bool _M_in_time = false; // Whether the changes of a time are not terminated yet.
+		std::size_t _M_next = 0; // Index after the last change of this time.
+
+		void _M_put(const std::vector<std::uint8_t> &bytes) {
+			std::fwrite(bytes.data(), 1, bytes.size(), this->_M_file);
+			this->_M_position += bytes.size();
+		}
+
+		void _M_end_time() {
+			if (!this->_M_in_time) return;
+			this->_M_block.push_back(0);
+			this->_M_in_time = false;
+		}
+
+		void _M_begin_block(std::uint64_t time) {
+			this->_M_first = this->_M_last = time;
+			for (auto word: this->_M_values) trace_file::put_varint(this->_M_block, word);
+		}
+
+		void _M_end_block() {
+			using namespace trace_file;
+			this->_M_end_time();
+			if (this->_M_block.empty()) return;
+
+			const std::vector<std::uint8_t> *payload = &this->_M_block;
+			std::uint32_t flags = 0;
+			if (this->_M_compress) {
+				this->_M_packed.clear();
+				lz::compress(this->_M_block.data(), this->_M_block.size(), this->_M_packed);
+				if (this->_M_packed.size() < this->_M_block.size()) {
+					payload = &this->_M_packed;
+					flags   = kCompressed;
+				}
+			}
+
+			std::vector<std::uint8_t> header;
+			put(header, this->_M_first);
+			put(header, this->_M_last);
+			put(header, static_cast<std::uint32_t>(this->_M_block.size()));
+			put(header, static_cast<std::uint32_t>(payload->size()));
+			put(header, flags);
+			this->_M_index.push_back({this->_M_first, this->_M_last, this->_M_position});
+			this->_M_put(header);
+			this->_M_put(*payload);
+			this->_M_block.clear();
+		}
+
+	public:
+		BinaryTraceWriter(const std::string &path, bool compress)
+			: _M_file(open_file(path, "wb")), _M_compress(compress) {}
+		BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+		BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+		~BinaryTraceWriter() override { std::fclose(this->_M_file); }
+
+		void begin(const std::vector<TraceSignal> &signals) override {
+			using namespace trace_file;
+			std::vector<std::uint8_t> header(kMagic, kMagic + sizeof(kMagic));
+			put(header, kVersion);
+			put(header, static_cast<std::uint32_t>(signals.size()));
+			for (auto &signal: signals) {
+				put(header, static_cast<std::uint32_t>(signal.width));
+				put(header, static_cast<std::uint8_t>(signal.is_register));
+				for (auto *text: {&signal.scope, &signal.name}) {
+					put(header, static_cast<std::uint16_t>(text->size()));
+					header.insert(header.end(), text->begin(), text->end());
+				}
+				this->_M_offset.push_back(this->_M_values.size());
+				this->_M_words.push_back(signal.words());
+				this->_M_values.resize(this->_M_values.size() + signal.words());
+			}
+			this->_M_put(header);
+			this->_M_block.reserve(kBlockBytes + kBlockBytes / 4);
+		}
+
+		void write(const TraceChunk &chunk) override {
+			using namespace trace_file;
+			auto &block = this->_M_block;
+			for (std::size_t i = 0; i < chunk.size();) {
+				if (chunk[i] == kTimeTag) {
+					const auto time = chunk[i + 1];
+					this->_M_end_time();
+					if (block.size() >= kBlockBytes) this->_M_end_block();
+					if (block.empty()) this->_M_begin_block(time);
+					put_varint(block, time - this->_M_last);
+					this->_M_last    = time;
+					this->_M_in_time = true;
+					this->_M_next    = 0;
+					i += 2;
+					continue;
+				}
+				const auto index = static_cast<std::size_t>(chunk[i++]);
+				put_varint(block, index - this->_M_next + 1);
+				this->_M_next = index + 1;
+				auto *value   = this->_M_values.data() + this->_M_offset[index];
+				for (std::size_t w = 0; w < this->_M_words[index]; ++w, ++i) {
+					put_varint(block, zigzag(chunk[i] - value[w]));
+					value[w] = chunk[i];
+				}
+			}
+		}
+
+		void end() override {
+			using namespace trace_file;
+			this->_M_end_block();
+			const auto index_offset = this->_M_position;
+			std::vector<std::uint8_t> footer(kIndexMagic, kIndexMagic + sizeof(kIndexMagic));
+			put(footer, static_cast<std::uint64_t>(this->_M_index.size()));
+			for (auto [first, last, offset]: this->_M_index) {
+				put(footer, first);
+				put(footer, last);
+				put(footer, offset);
+			}
+			put(footer, index_offset);
+			footer.insert(footer.end(), kEndMagic, kEndMagic + sizeof(kEndMagic));
+			this->_M_put(footer);
+			std::fflush(this->_M_file);
+		}
+	};
+
+} // namespace details
+
+} // namespace dark
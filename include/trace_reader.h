@@ -0,0 +1,235 @@
+#pragma once
+#include "trace_format.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <optional>
+
+namespace dark {
+
+/**
+ * @brief Reader of binary trace files. Only the header and the block index
+ * are read when opened, and blocks are read on demand, so a time window
+ * of a long trace is extracted without reading the whole file.
+ */
+class TraceReader {
+public:
+	using Signal = details::TraceSignal;
+	using Block  = details::trace_file::BlockInfo;
+
+	/* A value of one signal, since the time of the sample. */
+	struct Sample {
+		std::uint64_t time;
+		std::vector<details::word_t> value;
+	};
+
+private:
+	struct Closer {
+		void operator()(std::FILE *file) const { std::fclose(file); }
+	};
+
+	std::unique_ptr<std::FILE, Closer> _M_file;
+	std::vector<Signal> _M_signals;
+	std::vector<std::size_t> _M_offset; // First word of each signal in a state.
+	std::size_t _M_state_words = 0;
+	std::vector<Block> _M_blocks;
+	std::uint64_t _M_data_begin = 0; // Offset of the first block.
+	std::uint64_t _M_size       = 0;
+
+	std::vector<std::uint8_t> _M_raw;
+	std::vector<std::uint8_t> _M_stored;
+
+	[[noreturn]] static void _M_corrupt() { throw std::runtime_error("Corrupt trace file."); }
+
+	void _M_read_at(std::uint64_t offset, void *data, std::size_t size) {
+		if (offset > this->_M_size || size > this->_M_size - offset) _M_corrupt();
+		if (std::fseek(this->_M_file.get(), static_cast<long>(offset), SEEK_SET) != 0 ||
+			std::fread(data, 1, size, this->_M_file.get()) != size)
+			_M_corrupt();
+	}
+
+	void _M_read_header() {
+		using namespace details::trace_file;
+		std::uint8_t fixed[16];
+		this->_M_read_at(0, fixed, sizeof(fixed));
+		if (std::memcmp(fixed, kMagic, sizeof(kMagic)) != 0) _M_corrupt();
+		if (get<std::uint32_t>(fixed + 8) != kVersion)
+			throw std::runtime_error("Unsupported trace file version.");
+
+		std::uint64_t pos = sizeof(fixed);
+		const auto count  = get<std::uint32_t>(fixed + 12);
+		auto read_text    = [&]() {
+			std::uint8_t length[2];
+			this->_M_read_at(pos, length, 2);
+			std::string text(get<std::uint16_t>(length), '\0');
+			this->_M_read_at(pos + 2, text.data(), text.size());
+			pos += 2 + text.size();
+			return text;
+		};
+		for (std::uint32_t i = 0; i < count; ++i) {
+			std::uint8_t info[5];
+			this->_M_read_at(pos, info, sizeof(info));
+			pos += sizeof(info);
+			Signal signal;
+			signal.width       = get<std::uint32_t>(info);
+			signal.is_register = info[4] != 0;
+			signal.scope       = read_text();
+			signal.name        = read_text();
+			this->_M_offset.push_back(this->_M_state_words);
+			this->_M_state_words += signal.words();
+			this->_M_signals.push_back(std::move(signal));
+		}
+		this->_M_data_begin = pos;
+	}
+
+	/* Read the index, or rebuild it from the block headers. */
+	void _M_read_index() {
+		using namespace details::trace_file;
+		if (this->_M_size >= this->_M_data_begin + kTrailerSize) {
+			std::uint8_t trailer[kTrailerSize];
+			this->_M_read_at(this->_M_size - kTrailerSize, trailer, kTrailerSize);
+			if (std::memcmp(trailer + 8, kEndMagic, sizeof(kEndMagic)) == 0) {
+				const auto offset = get<std::uint64_t>(trailer);
+				std::uint8_t head[16];
+				this->_M_read_at(offset, head, sizeof(head));
+				if (std::memcmp(head, kIndexMagic, sizeof(kIndexMagic)) != 0) _M_corrupt();
+				/* The count is checked against the file before anything is allocated. */
+				const auto count = get<std::uint64_t>(head + 8);
+				if (count > (this->_M_size - offset - sizeof(head)) / kIndexEntrySize) _M_corrupt();
+				std::vector<std::uint8_t> index(count * kIndexEntrySize);
+				this->_M_read_at(offset + sizeof(head), index.data(), index.size());
+				this->_M_blocks.reserve(count);
+				for (std::size_t i = 0; i < index.size(); i += kIndexEntrySize)
+					this->_M_blocks.push_back({get<std::uint64_t>(&index[i]), get<std::uint64_t>(&index[i + 8]),
+											   get<std::uint64_t>(&index[i + 16])});
+				return;
+			}
+		}
+		/* The writer did not finish: keep the blocks which are complete. */
+		for (auto pos = this->_M_data_begin; pos + kBlockHeaderSize <= this->_M_size;) {
+			std::uint8_t header[kBlockHeaderSize];
+			this->_M_read_at(pos, header, kBlockHeaderSize);
+			const auto next = pos + kBlockHeaderSize + get<std::uint32_t>(header + 20);
+			if (next > this->_M_size) break;
+			this->_M_blocks.push_back({get<std::uint64_t>(header), get<std::uint64_t>(header + 8), pos});
+			pos = next;
+		}
+	}
+
+public:
+	/* @throw std::runtime_error if the file cannot be opened or is not a trace. */
+	explicit TraceReader(const std::string &path) : _M_file(details::open_file(path, "rb")) {
+		std::fseek(this->_M_file.get(), 0, SEEK_END);
+		this->_M_size = static_cast<std::uint64_t>(std::ftell(this->_M_file.get()));
+		this->_M_read_header();
+		this->_M_read_index();
+	}
+
+	const std::vector<Signal> &signals() const { return this->_M_signals; }
+	const std::vector<Block> &blocks() const { return this->_M_blocks; }
+
+	/* Find a signal by "scope.name". */
+	std::optional<std::size_t> find(const std::string &name) const {
+		for (std::size_t i = 0; i < this->_M_signals.size(); ++i)
+			if (this->_M_signals[i].scope + '.' + this->_M_signals[i].name == name) return i;
+		return std::nullopt;
+	}
+
+	/**
+	 * @brief Decode a block. state receives the values of all signals before
+	 * the block (one signal after another), and chunk the changes in it.
+	 */
+	void read(std::size_t block, std::vector<details::word_t> &state, details::TraceChunk &chunk) {
+		using namespace details::trace_file;
+		std::uint8_t header[kBlockHeaderSize];
+		const auto offset = this->_M_blocks.at(block).offset;
+		this->_M_read_at(offset, header, kBlockHeaderSize);
+		const auto first  = get<std::uint64_t>(header);
+		const auto raw    = get<std::uint32_t>(header + 16);
+		const auto stored = get<std::uint32_t>(header + 20);
+		const auto flags  = get<std::uint32_t>(header + 24);
+
+		this->_M_raw.resize(raw);
+		if (flags & kCompressed) {
+			this->_M_stored.resize(stored);
+			this->_M_read_at(offset + kBlockHeaderSize, this->_M_stored.data(), stored);
+			if (!details::lz::decompress(this->_M_stored.data(), stored, this->_M_raw.data(), raw))
+				_M_corrupt();
+		}
+		else {
+			if (stored != raw) _M_corrupt();
+			this->_M_read_at(offset + kBlockHeaderSize, this->_M_raw.data(), raw);
+		}
+
+		const auto *data = this->_M_raw.data();
+		std::size_t pos  = 0;
+		state.resize(this->_M_state_words);
+		for (auto &word: state) word = get_varint(data, raw, pos);
+
+		std::vector<details::word_t> value = state;
+		auto time = first;
+		chunk.clear();
+		while (pos < raw) {
+			time += get_varint(data, raw, pos);
+			chunk.push_back(details::kTimeTag);
+			chunk.push_back(time);
+			for (std::size_t next = 0;;) {
+				const auto gap = get_varint(data, raw, pos);
+				if (gap == 0) break;
+				const auto index = next + gap - 1;
+				if (index >= this->_M_signals.size()) _M_corrupt();
+				next = index + 1;
+				chunk.push_back(index);
+				auto *words = value.data() + this->_M_offset[index];
+				for (std::size_t w = 0; w < this->_M_signals[index].words(); ++w) {
+					words[w] += unzigzag(get_varint(data, raw, pos));
+					chunk.push_back(words[w]);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief The value of a signal at time first, and each change until time
+	 * last. Only the blocks overlapping the window are read.
+	 */
+	std::vector<Sample> query(std::size_t signal, std::uint64_t first, std::uint64_t last) {
+		const auto words  = this->_M_signals.at(signal).words();
+		const auto offset = static_cast<std::ptrdiff_t>(this->_M_offset[signal]);
+		auto &blocks      = this->_M_blocks;
+
+		/* Start from the last block beginning at or before first, as values persist across blocks. */
+		auto iter  = std::upper_bound(blocks.begin(), blocks.end(), first,
+									  [](std::uint64_t time, const Block &block) { return time < block.first; });
+		auto begin = iter == blocks.begin() ? iter : iter - 1;
+
+		std::vector<Sample> result(1, {first, std::vector<details::word_t>(words)});
+		std::vector<details::word_t> state;
+		details::TraceChunk chunk;
+		for (auto b = begin; b != blocks.end() && b->first <= last; ++b) {
+			this->read(static_cast<std::size_t>(b - blocks.begin()), state, chunk);
+			if (b == begin) std::copy_n(state.begin() + offset, words, result[0].value.begin());
+
+			std::uint64_t time = 0;
+			for (std::size_t i = 0; i < chunk.size();) {
+				if (chunk[i] == details::kTimeTag) {
+					time = chunk[i + 1];
+					i += 2;
+					continue;
+				}
+				const auto index = static_cast<std::size_t>(chunk[i++]);
+				if (index == signal && time <= last) {
+					auto value = chunk.begin() + static_cast<std::ptrdiff_t>(i);
+					if (time <= first)
+						std::copy_n(value, words, result[0].value.begin());
+					else
+						result.push_back({time, std::vector<details::word_t>(value, value + words)});
+				}
+				i += this->_M_signals[index].words();
+			}
+		}
+		return result;
+	}
+};
+
+} // namespace dark
@@ -0,0 +1,223 @@
+#pragma once
+#include "bit.h"
+#include <algorithm>
+#include <array>
+#include <type_traits>
+
+namespace dark {
+
+namespace details {
+
+	/* Wide bit vectors are stored in 64-bit words, least significant first. */
+	using word_t = std::uint64_t;
+
+	inline constexpr std::size_t kWordBits = std::numeric_limits<word_t>::digits;
+
+	template<std::size_t _Nm>
+	inline constexpr std::size_t kWordCount = (_Nm + kWordBits - 1) / kWordBits;
+
+	/* Mask of the valid bits in the most significant word. */
+	template<std::size_t _Nm>
+	inline constexpr word_t kTopMask =
+			_Nm % kWordBits == 0 ? ~word_t(0) : (word_t(1) << (_Nm % kWordBits)) - 1;
+
+	/* Load 64 bits starting at bit pos. Bits beyond the array are zero. */
+	template<std::size_t _Words>
+	constexpr word_t load_bits(const std::array<word_t, _Words> &src, std::size_t pos) {
+		const auto index = pos / kWordBits;
+		const auto shift = pos % kWordBits;
+		if (index >= _Words) return 0;
+		word_t value = src[index] >> shift;
+		if (shift != 0 && index + 1 < _Words) value |= src[index + 1] << (kWordBits - shift);
+		return value;
+	}
+
+	/* Store the low len bits (len <= 64) of value at bit pos. */
+	template<std::size_t _Words>
+	constexpr void store_bits(std::array<word_t, _Words> &dst, std::size_t pos,
+							  word_t value, std::size_t len) {
+		const auto index = pos / kWordBits;
+		const auto shift = pos % kWordBits;
+		const auto mask  = len == kWordBits ? ~word_t(0) : (word_t(1) << len) - 1;
+		value &= mask;
+		dst[index] = (dst[index] & ~(mask << shift)) | (value << shift);
+		if (shift != 0 && shift + len > kWordBits) {
+			const auto high = kWordBits - shift;
+			dst[index + 1]  = (dst[index + 1] & ~(mask >> high)) | (value >> high);
+		}
+	}
+
+} // namespace details
+
+/**
+ * @brief Bit vector wider than max_size_t.
+ * Bits are kept in native 64-bit words, so a vector of at most 64 bits is
+ * a single uint64_t. Bits above _Nm are always zero.
+ */
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+struct Bit<_Nm> {
+public:
+	static constexpr std::size_t _Bit_Len = _Nm;
+	static constexpr std::size_t _Words   = details::kWordCount<_Nm>;
+
+	using _Word_t  = details::word_t;
+	using _Array_t = std::array<_Word_t, _Words>;
+
+private:
+	_Array_t _M_data; // Real storage
+
+	constexpr void _M_trim() { this->_M_data[_Words - 1] &= details::kTopMask<_Nm>; }
+
+	template<typename _Tp>
+	constexpr void _M_store(std::size_t pos, const _Tp &val);
+
+	template<std::size_t _Hi, std::size_t _Lo>
+	static constexpr void _M_range_check();
+
+public:
+	constexpr Bit() : _M_data() {}
+
+	/* Signed values are sign-extended, as max_size_t values are clipped. */
+	template<std::integral _Int>
+	constexpr Bit(_Int data) : _M_data() {
+		if constexpr (std::is_signed_v<_Int>)
+			if (data < 0) this->_M_data.fill(~_Word_t(0));
+		this->_M_data[0] = static_cast<_Word_t>(data);
+		this->_M_trim();
+	}
+
+	constexpr explicit Bit(const _Array_t &words) : _M_data(words) { this->_M_trim(); }
+
+	template<typename... _Tp>
+		requires(sizeof...(_Tp) > 1 && ((concepts::bit_type<_Tp> || concepts::wide_type<_Tp>) && ...) &&
+				 (_Tp::_Bit_Len + ...) == _Nm)
+	constexpr Bit(const _Tp &...args) : _M_data() {
+		std::size_t pos = _Nm;
+		((pos -= _Tp::_Bit_Len, this->_M_store(pos, args)), ...);
+	}
+
+	constexpr const _Array_t &words() const { return this->_M_data; }
+	constexpr _Word_t word(std::size_t pos) const { return this->_M_data[pos]; }
+
+	constexpr explicit operator bool() const {
+		return std::ranges::any_of(this->_M_data, [](_Word_t word) { return word != 0; });
+	}
+
+	template<std::size_t _Hi, std::size_t _Lo = _Hi, typename _Tp>
+	constexpr void set(const _Tp &val);
+
+	template<std::size_t _Hi, std::size_t _Lo = _Hi>
+	constexpr auto range() const -> Bit<_Hi - _Lo + 1>;
+
+	template<std::size_t _Len = 1>
+	constexpr auto slice(std::size_t pos) const -> Bit<_Len>;
+
+	constexpr Bit<1> operator[](std::size_t pos) const { return this->slice(pos); }
+};
+
+template<typename... _Tp>
+	requires((concepts::bit_type<_Tp> || concepts::wide_type<_Tp>) && ...) &&
+			(... || concepts::wide_type<_Tp>)
+Bit(_Tp...) -> Bit<(_Tp::_Bit_Len + ...)>;
+
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+template<typename _Tp>
+constexpr void Bit<_Nm>::_M_store(std::size_t pos, const _Tp &val) {
+	if constexpr (concepts::wide_type<_Tp>) {
+		constexpr auto _Len = _Tp::_Bit_Len;
+		const auto value    = static_cast<Bit<_Len>>(val);
+		for (std::size_t i = 0; i < Bit<_Len>::_Words; ++i)
+			details::store_bits(this->_M_data, pos + i * details::kWordBits, value.word(i),
+								std::min(details::kWordBits, _Len - i * details::kWordBits));
+	}
+	else if constexpr (concepts::bit_type<_Tp>) {
+		details::store_bits(this->_M_data, pos, static_cast<max_size_t>(val), _Tp::_Bit_Len);
+	}
+	else {
+		static_assert(sizeof(_Tp) == 0, "Bit::store: unsupported type");
+	}
+}
+
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+template<std::size_t _Hi, std::size_t _Lo>
+constexpr void Bit<_Nm>::_M_range_check() {
+	static_assert(_Lo <= _Hi, "Bit::range_check: _Lo should be no greater than _Hi");
+	static_assert(_Hi < _Nm, "Bit::range_check: _Hi should be less than _Nm");
+}
+
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+template<std::size_t _Hi, std::size_t _Lo, typename _Tp>
+constexpr void Bit<_Nm>::set(const _Tp &val) {
+	this->_M_range_check<_Hi, _Lo>();
+	constexpr auto _Length = _Hi - _Lo + 1;
+	if constexpr (concepts::int_type<_Tp>)
+		this->_M_store(_Lo, Bit<_Length>(val));
+	else {
+		static_assert(_Tp::_Bit_Len == _Length, "Bit::set: length mismatch");
+		this->_M_store(_Lo, val);
+	}
+}
+
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+template<std::size_t _Hi, std::size_t _Lo>
+constexpr auto Bit<_Nm>::range() const -> Bit<_Hi - _Lo + 1> {
+	this->_M_range_check<_Hi, _Lo>();
+	return this->slice<_Hi - _Lo + 1>(_Lo);
+}
+
+template<std::size_t _Nm>
+	requires(_Nm > kMaxLength)
+template<std::size_t _Len>
+constexpr auto Bit<_Nm>::slice(std::size_t pos) const -> Bit<_Len> {
+	static_assert(_Len <= _Nm, "Bit::slice: _Len should be no greater than _Nm");
+	debug::assert(pos <= _Nm - _Len, "Bit::slice: pos should be less than _Nm - _Len");
+	if constexpr (_Len <= kMaxLength) {
+		return Bit<_Len>(static_cast<max_size_t>(details::load_bits(this->_M_data, pos)));
+	}
+	else {
+		typename Bit<_Len>::_Array_t words;
+		for (std::size_t i = 0; i < Bit<_Len>::_Words; ++i)
+			words[i] = details::load_bits(this->_M_data, pos + i * details::kWordBits);
+		return Bit<_Len>(words);
+	}
+}
+
+/* Read a wide value, or convert an integer, as a Bit<_Len>. */
+template<std::size_t _Len, typename _Tp>
+	requires concepts::wide_convertible<_Tp, _Len>
+constexpr auto wide_cast(const _Tp &value) {
+	if constexpr (concepts::wide_type<_Tp>)
+		return static_cast<Bit<_Len>>(value);
+	else if constexpr (std::integral<_Tp>)
+		return Bit<_Len>(value);
+	else
+		return Bit<_Len>(static_cast<max_size_t>(value));
+}
+
+template<std::size_t _New, concepts::wide_type _Tp>
+constexpr auto zero_extend(const _Tp &val) {
+	static_assert(_Tp::_Bit_Len < _New, "zero_extend: _Old should be less than _New");
+	return Bit<_New>(Bit<_New - _Tp::_Bit_Len>(0), val);
+}
+
+template<std::size_t _New, concepts::wide_type _Tp>
+constexpr auto sign_extend(const _Tp &val) {
+	constexpr auto _Old = _Tp::_Bit_Len;
+	static_assert(_Old <= _New, "sign_extend: _Old should be less than _New");
+	const auto value = static_cast<Bit<_Old>>(val);
+	if constexpr (_Old == _New) {
+		return value;
+	}
+	else {
+		constexpr auto _Sign = _Old - 1;
+		const bool negative  = (value.word(_Sign / details::kWordBits) >> (_Sign % details::kWordBits)) & 1;
+		return Bit<_New>(Bit<_New - _Old>(negative ? -1 : 0), value);
+	}
+}
+
+} // namespace dark
@@ -1,7 +1,17 @@
 #pragma once
 #include "concept.h"
+#include "counter.h"
 #include "debug.h"
-#include <memory>
+#include "dirty.h"
+#include "register.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 namespace dark {
 
@@ -11,31 +21,124 @@ namespace details {
 	concept WireFunction =
 			concepts::bit_convertible<std::decay_t<std::invoke_result_t<_Fn>>, _Len>;
 
-	struct FuncBase {
-		using _Ret_t = max_size_t;
-		using _Cpy_t = FuncBase *;
-		virtual _Ret_t call() const = 0;
-		virtual _Cpy_t copy() const = 0;
-		virtual ~FuncBase() = default;
-	};
+	template<typename _Fn, std::size_t _Len>
+	concept WideWireFunction =
+			concepts::wide_convertible<std::decay_t<std::invoke_result_t<_Fn>>, _Len>;
 
-	template<std::size_t _Len, WireFunction<_Len> _Fn>
-	struct FuncImpl final : FuncBase {
-		_Fn _M_lambda;
+	/* Size of the inline buffer which holds the function of a wire. */
+	inline constexpr std::size_t kWireBufferSize = 4 * sizeof(void *);
 
-		template<typename _Tp>
-		FuncImpl(_Tp &&fn) : _M_lambda(std::forward<_Tp>(fn)) {}
+	template<typename _Fn>
+	concept WireStorable =
+			sizeof(_Fn) <= kWireBufferSize && alignof(_Fn) <= alignof(void *);
 
-		_Ret_t call() const override { return static_cast<_Ret_t>(this->_M_lambda()); }
-		_Cpy_t copy() const override { return new FuncImpl(*this); }
-	};
+	/**
+	 * @brief Allocation-free storage of a wire function.
+	 * The function object lives in an inline buffer, and is called
+	 * through a plain function pointer instead of a virtual call.
+	 */
+	template<typename _Ret>
+	struct BasicFuncStorage {
+	public:
+		using _Ret_t  = _Ret;
+		using _Call_t = _Ret_t (*)(const void *);
+		using _Drop_t = void (*)(void *);
 
-	struct EmptyWire final : FuncBase {
-		_Ret_t call() const override {
+	private:
+		alignas(void *) std::byte _M_buffer[kWireBufferSize];
+		_Call_t _M_call;
+		_Drop_t _M_drop;
+
+		static _Ret_t _M_empty(const void *) {
 			debug::assert(false, "Empty wire is called.");
 			debug::unreachable();
 		}
-		_Cpy_t copy() const override { return new EmptyWire; }
+
+		template<typename _Fn>
+		static _Ret_t _M_invoke(const void *ptr) {
+			return static_cast<_Ret_t>((*static_cast<const _Fn *>(ptr))());
+		}
+
+		template<typename _Fn>
+		static void _M_destroy(void *ptr) { static_cast<_Fn *>(ptr)->~_Fn(); }
+
+		void _M_reset() {
+			if (this->_M_drop != nullptr) this->_M_drop(this->_M_buffer);
+			this->_M_call = &_M_empty;
+			this->_M_drop = nullptr;
+		}
+
+	public:
+		BasicFuncStorage() : _M_buffer(), _M_call(&_M_empty), _M_drop(nullptr) {}
+		~BasicFuncStorage() { this->_M_reset(); }
+
+		BasicFuncStorage(BasicFuncStorage &&) = delete;
+		BasicFuncStorage(const BasicFuncStorage &) = delete;
+		BasicFuncStorage &operator=(BasicFuncStorage &&) = delete;
+		BasicFuncStorage &operator=(const BasicFuncStorage &) = delete;
+
+		template<typename _Tp>
+		void emplace(_Tp &&fn) {
+			using _Fn = std::decay_t<_Tp>;
+			static_assert(WireStorable<_Fn>,
+						  "Wire function is too large. Capture by reference instead of by value.");
+			this->_M_reset();
+			::new (static_cast<void *>(this->_M_buffer)) _Fn(std::forward<_Tp>(fn));
+			this->_M_call = &_M_invoke<_Fn>;
+			if constexpr (!std::is_trivially_destructible_v<_Fn>)
+				this->_M_drop = &_M_destroy<_Fn>;
+		}
+
+		_Ret_t call() const { return this->_M_call(this->_M_buffer); }
+		bool empty() const { return this->_M_call == &_M_empty; }
+	};
+
+	using FuncStorage = BasicFuncStorage<max_size_t>;
+
+	/* How a wire gets its value. */
+	enum class WireKind : unsigned char {
+		Function,  // Call the stored function, with cache.
+		RegAlias,  // Alias of a register, read directly.
+		WireAlias, // Alias of another wire, read directly.
+	};
+
+	/* Cache state of a wire with a function, within one cycle. */
+	enum class WireState : unsigned char {
+		Stale,     // Not evaluated yet.
+		Busy,      // Being stored by one thread.
+		Ready,     // Cache holds the value of this cycle.
+	};
+
+	/* Number of parallel phases running, during which wires may be shared. */
+	inline constinit std::atomic<unsigned> concurrent_phases = 0;
+
+	/**
+	 * @brief Discovers the evaluation order of wires.
+	 * While a tracer is active, every wire read is redirected to it. Each wire
+	 * is evaluated once, after all the wires it reads, so the wires with a
+	 * function are recorded in a topological order.
+	 */
+	struct WireTracer {
+	public:
+		struct Step {
+			const void *wire;
+			void (*eval)(const void *);
+		};
+
+		static inline WireTracer *active = nullptr;
+
+		std::vector<Step> order;
+
+		template<std::size_t _Len>
+		auto read(const Wire<_Len> &wire);
+
+	private:
+		struct Node {
+			bool visiting;
+			max_size_t value;
+			std::vector<word_t> words; // Value of a wide wire.
+		};
+		std::unordered_map<const void *, Node> _M_nodes;
 	};
 
 } // namespace details
@@ -48,24 +151,64 @@ private:
 				  "Wire: _Len must be in range [1, kMaxLength].");
 
 	friend class Visitor;
+	friend struct Probe;
+	friend class SyncPlan;
+	friend struct details::WireTracer;
 
-	using _Manage_t = std::unique_ptr<details::FuncBase>;
-
-	_Manage_t _M_func;
+	details::FuncStorage _M_func;
+	const void *_M_source;
+	details::WireKind _M_kind;
 
-	mutable max_size_t _M_cache : _Len;
-	mutable bool _M_holds;
+	mutable details::Cell<_Len> _M_cache;
+	mutable std::atomic<details::WireState> _M_state;
 
 	[[no_unique_address]]
 	debug::DebugValue<bool, false> _M_assigned;
 
 private:
-	void sync() { this->_M_holds = false; }
+	void sync() { this->_M_state.store(details::WireState::Stale, std::memory_order_relaxed); }
 
-	template<details::WireFunction<_Len> _Fn>
-	static auto _M_new_func(_Fn &&fn) {
-		using _Decay_t = std::decay_t<_Fn>;
-		return new details::FuncImpl<_Len, _Decay_t>{std::forward<_Fn>(fn)};
+	/**
+	 * Race-free lazy evaluation: every reader of a stale wire may compute the
+	 * value, but only the first one claims the cache and stores it. Readers
+	 * that see a ready cache never write, so no lock is needed. Outside of
+	 * parallel phases the claim is skipped, as there is only one reader.
+	 */
+	max_size_t _M_evaluate() const {
+		using enum details::WireState;
+		if (this->_M_state.load(std::memory_order_acquire) == Ready)
+			return this->_M_cache.get();
+
+		const auto value = this->_M_func.call() & make_mask<_Len>();
+		if (details::concurrent_phases.load(std::memory_order_relaxed) != 0) {
+			auto expected = Stale;
+			if (!this->_M_state.compare_exchange_strong(expected, Busy, std::memory_order_relaxed))
+				return value;
+		}
+		this->_M_cache.set(value);
+		this->_M_state.store(Ready, std::memory_order_release);
+		details::DirtyList::mark(const_cast<Wire *>(this),
+								 [](void *ptr) { static_cast<Wire *>(ptr)->sync(); });
+		details::EventCounts::count_evaluation();
+		return value;
+	}
+
+	/* Evaluate without the cache. */
+	max_size_t _M_compute() const {
+		using enum details::WireKind;
+		if (this->_M_kind == RegAlias)
+			return static_cast<const Register<_Len> *>(this->_M_source)->_M_read();
+		if (this->_M_kind == WireAlias)
+			return static_cast<max_size_t>(*static_cast<const Wire *>(this->_M_source));
+		return this->_M_func.call() & make_mask<_Len>();
+	}
+
+	/* Whether reading this wire is valid, i.e. it has a function or a source. */
+	bool _M_connected() const {
+		using enum details::WireKind;
+		if (this->_M_kind == WireAlias)
+			return static_cast<const Wire *>(this->_M_source)->_M_connected();
+		return this->_M_kind == RegAlias || !this->_M_func.empty();
 	}
 
 	void _M_checked_assign() {
@@ -73,40 +216,67 @@ private:
 		this->_M_assigned = true;
 	}
 
+	void _M_bind(const void *source, details::WireKind kind) {
+		this->_M_checked_assign();
+		this->_M_source = source;
+		this->_M_kind   = kind;
+		this->sync();
+	}
+
 public:
 	static constexpr std::size_t _Bit_Len = _Len;
 
-	Wire() : _M_func(new details::EmptyWire),
-			 _M_cache(), _M_holds(), _M_assigned() {}
+	Wire() : _M_func(), _M_source(), _M_kind(details::WireKind::Function),
+			 _M_cache(), _M_state(details::WireState::Stale), _M_assigned() {}
 
 	explicit operator max_size_t() const {
-		if (this->_M_holds == false) {
-			this->_M_holds = true;
-			this->_M_cache = this->_M_func->call();
-		}
-		return this->_M_cache;
+		using enum details::WireKind;
+		if (auto *tracer = details::WireTracer::active; tracer != nullptr) [[unlikely]]
+			return tracer->read(*this);
+		if (this->_M_kind != Function)
+			return this->_M_compute();
+		return this->_M_evaluate();
 	}
 
 	Wire(Wire &&) = delete;
 	Wire(const Wire &) = delete;
 	Wire &operator=(Wire &&) = delete;
-	Wire &operator=(const Wire &rhs) = delete;
 
 	template<details::WireFunction<_Len> _Fn>
-	Wire(_Fn &&fn) : _M_func(_M_new_func(std::forward<_Fn>(fn))),
-					 _M_cache(), _M_holds(), _M_assigned() {}
+	Wire(_Fn &&fn) : _M_func(), _M_source(), _M_kind(details::WireKind::Function),
+					 _M_cache(), _M_state(details::WireState::Stale), _M_assigned() {
+		this->_M_func.emplace(std::forward<_Fn>(fn));
+	}
 
 	template<details::WireFunction<_Len> _Fn>
 	Wire &operator=(_Fn &&fn) {
 		return this->assign(std::forward<_Fn>(fn)), *this;
 	}
 
-	Wire &operator=(const Register <_Len> &rhs);
+	/* Bind this wire as an alias of a register, same as bind(rhs). */
+	Wire &operator=(const Register<_Len> &rhs) { return this->bind(rhs), *this; }
+
+	/**
+	 * @brief Bind this wire as an alias of another wire, same as bind(rhs).
+	 * Unlike a usual copy assignment, nothing is copied: reads of this wire
+	 * go to rhs from now on, so rhs must outlive it.
+	 */
+	Wire &operator=(const Wire &rhs) { return this->bind(rhs), *this; }
+
+	/* Bind this wire as an alias of a register: reads go straight to it. */
+	void bind(const Register<_Len> &source) { this->_M_bind(&source, details::WireKind::RegAlias); }
+
+	/* Bind this wire as an alias of another wire: reads go straight to it. */
+	void bind(const Wire &source) {
+		debug::assert(&source != this, "Wire cannot be bound to itself.");
+		this->_M_bind(&source, details::WireKind::WireAlias);
+	}
 
 	template<details::WireFunction<_Len> _Fn>
 	void assign(_Fn &&fn) {
 		this->_M_checked_assign();
-		this->_M_func.reset(_M_new_func(std::forward<_Fn>(fn)));
+		this->_M_func.emplace(std::forward<_Fn>(fn));
+		this->_M_kind = details::WireKind::Function;
 		this->sync();
 	}
 
@@ -115,5 +285,182 @@ public:
 	}
 };
 
+/**
+ * @brief Wire wider than max_size_t, whose value is a Bit<_Len>.
+ * It behaves exactly like a narrow wire.
+ */
+template<std::size_t _Len>
+	requires(_Len > kMaxLength)
+struct Wire<_Len> {
+private:
+	friend class Visitor;
+	friend struct Probe;
+	friend class SyncPlan;
+	friend struct details::WireTracer;
+
+	details::BasicFuncStorage<Bit<_Len>> _M_func;
+	const void *_M_source;
+	details::WireKind _M_kind;
+
+	mutable Bit<_Len> _M_cache;
+	mutable std::atomic<details::WireState> _M_state;
+
+	[[no_unique_address]]
+	debug::DebugValue<bool, false> _M_assigned;
+
+private:
+	void sync() { this->_M_state.store(details::WireState::Stale, std::memory_order_relaxed); }
+
+	/* Same protocol as the narrow wire. */
+	Bit<_Len> _M_evaluate() const {
+		using enum details::WireState;
+		if (this->_M_state.load(std::memory_order_acquire) == Ready)
+			return this->_M_cache;
+
+		const auto value = this->_M_func.call();
+		if (details::concurrent_phases.load(std::memory_order_relaxed) != 0) {
+			auto expected = Stale;
+			if (!this->_M_state.compare_exchange_strong(expected, Busy, std::memory_order_relaxed))
+				return value;
+		}
+		this->_M_cache = value;
+		this->_M_state.store(Ready, std::memory_order_release);
+		details::DirtyList::mark(const_cast<Wire *>(this),
+								 [](void *ptr) { static_cast<Wire *>(ptr)->sync(); });
+		details::EventCounts::count_evaluation();
+		return value;
+	}
+
+	Bit<_Len> _M_compute() const {
+		using enum details::WireKind;
+		if (this->_M_kind == RegAlias)
+			return static_cast<const Register<_Len> *>(this->_M_source)->_M_read();
+		if (this->_M_kind == WireAlias)
+			return static_cast<Bit<_Len>>(*static_cast<const Wire *>(this->_M_source));
+		return this->_M_func.call();
+	}
+
+	bool _M_connected() const {
+		using enum details::WireKind;
+		if (this->_M_kind == WireAlias)
+			return static_cast<const Wire *>(this->_M_source)->_M_connected();
+		return this->_M_kind == RegAlias || !this->_M_func.empty();
+	}
+
+	void _M_checked_assign() {
+		debug::assert(!this->_M_assigned, "Wire is assigned twice.");
+		this->_M_assigned = true;
+	}
+
+	void _M_bind(const void *source, details::WireKind kind) {
+		this->_M_checked_assign();
+		this->_M_source = source;
+		this->_M_kind   = kind;
+		this->sync();
+	}
+
+public:
+	static constexpr std::size_t _Bit_Len = _Len;
+
+	Wire() : _M_func(), _M_source(), _M_kind(details::WireKind::Function),
+			 _M_cache(), _M_state(details::WireState::Stale), _M_assigned() {}
+
+	explicit operator Bit<_Len>() const {
+		using enum details::WireKind;
+		if (auto *tracer = details::WireTracer::active; tracer != nullptr) [[unlikely]]
+			return tracer->read(*this);
+		if (this->_M_kind != Function)
+			return this->_M_compute();
+		return this->_M_evaluate();
+	}
+
+	Wire(Wire &&) = delete;
+	Wire(const Wire &) = delete;
+	Wire &operator=(Wire &&) = delete;
+
+	template<details::WideWireFunction<_Len> _Fn>
+	Wire(_Fn &&fn) : _M_func(), _M_source(), _M_kind(details::WireKind::Function),
+					 _M_cache(), _M_state(details::WireState::Stale), _M_assigned() {
+		this->_M_func.emplace(std::forward<_Fn>(fn));
+	}
+
+	template<details::WideWireFunction<_Len> _Fn>
+	Wire &operator=(_Fn &&fn) {
+		return this->assign(std::forward<_Fn>(fn)), *this;
+	}
+
+	/* Bind this wire as an alias of a register, same as bind(rhs). */
+	Wire &operator=(const Register<_Len> &rhs) { return this->bind(rhs), *this; }
+
+	/**
+	 * @brief Bind this wire as an alias of another wire, same as bind(rhs).
+	 * Unlike a usual copy assignment, nothing is copied: reads of this wire
+	 * go to rhs from now on, so rhs must outlive it.
+	 */
+	Wire &operator=(const Wire &rhs) { return this->bind(rhs), *this; }
+
+	/* Bind this wire as an alias of a register: reads go straight to it. */
+	void bind(const Register<_Len> &source) { this->_M_bind(&source, details::WireKind::RegAlias); }
+
+	/* Bind this wire as an alias of another wire: reads go straight to it. */
+	void bind(const Wire &source) {
+		debug::assert(&source != this, "Wire cannot be bound to itself.");
+		this->_M_bind(&source, details::WireKind::WireAlias);
+	}
+
+	template<details::WideWireFunction<_Len> _Fn>
+	void assign(_Fn &&fn) {
+		this->_M_checked_assign();
+		this->_M_func.emplace(std::forward<_Fn>(fn));
+		this->_M_kind = details::WireKind::Function;
+		this->sync();
+	}
+
+	explicit operator bool() const {
+		return static_cast<bool>(static_cast<Bit<_Len>>(*this));
+	}
+};
+
+template<std::size_t _Len>
+auto details::WireTracer::read(const Wire<_Len> &wire) {
+	using _Value_t = decltype(wire._M_compute());
+
+	auto store = [](const _Value_t &value) {
+		Node node{false, 0, {}};
+		if constexpr (_Len <= kMaxLength)
+			node.value = value;
+		else
+			node.words.assign(value.words().begin(), value.words().end());
+		return node;
+	};
+	auto load = [](const Node &node) {
+		if constexpr (_Len <= kMaxLength) {
+			return node.value;
+		}
+		else {
+			typename _Value_t::_Array_t words;
+			std::copy(node.words.begin(), node.words.end(), words.begin());
+			return _Value_t(words);
+		}
+	};
+
+	if (auto iter = this->_M_nodes.find(&wire); iter != this->_M_nodes.end()) {
+		if (iter->second.visiting)
+			throw std::logic_error("Combinational loop detected among wires.");
+		return load(iter->second);
+	}
+	if (wire._M_kind == WireKind::Function && wire._M_func.empty())
+		return this->_M_nodes[&wire] = store(_Value_t{}), _Value_t{}; // Not connected.
+
+	this->_M_nodes[&wire] = {true, 0, {}};
+	const auto value      = wire._M_compute();
+	this->_M_nodes[&wire] = store(value);
+
+	if (wire._M_kind == WireKind::Function)
+		this->order.push_back({&wire, [](const void *ptr) {
+			static_cast<_Value_t>(*static_cast<const Wire<_Len> *>(ptr));
+		}});
+	return value;
+}
 
 } // namespace dark
@@ -0,0 +1,32 @@
+/**
+ * Convert a binary trace (CPU::enable_trace with TraceFormat::Binary or
+ * TraceFormat::Compressed) to a VCD file.
+ *
+ * Usage: trace2vcd <trace> <output.vcd>
+ */
+#include "trace_reader.h"
+#include <iostream>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <trace> <output.vcd>\n";
+		return 1;
+	}
+	try {
+		dark::TraceReader reader(argv[1]);
+		dark::details::VcdWriter writer(argv[2]);
+		writer.begin(reader.signals());
+
+		std::vector<dark::details::word_t> state;
+		dark::details::TraceChunk chunk;
+		for (std::size_t b = 0; b < reader.blocks().size(); ++b) {
+			reader.read(b, state, chunk);
+			writer.write(chunk);
+		}
+		writer.end();
+	} catch (const std::exception &error) {
+		std::cerr << error.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
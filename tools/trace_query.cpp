@@ -0,0 +1,58 @@
+/**
+ * Print the values of one signal of a binary trace over a window of time.
+ * Only the blocks overlapping the window are read.
+ *
+ * Usage: trace_query <trace>                          list the signals
+ *        trace_query <trace> <scope.name> [first] [last]
+ * Each line is a time and the value in hexadecimal: first the value at
+ * time first, then every change until time last.
+ */
+#include "trace_reader.h"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 5) {
+		std::cerr << "Usage: " << argv[0] << " <trace> [<scope.name> [first] [last]]\n";
+		return 1;
+	}
+	try {
+		dark::TraceReader reader(argv[1]);
+		if (argc == 2) {
+			for (auto &signal: reader.signals())
+				std::cout << signal.scope << '.' << signal.name << '\t' << signal.width << '\t'
+						  << (signal.is_register ? "reg" : "wire") << '\n';
+			std::cout << reader.blocks().size() << " blocks";
+			if (!reader.blocks().empty())
+				std::cout << ", time " << reader.blocks().front().first << " to " << reader.blocks().back().last;
+			std::cout << '\n';
+			return 0;
+		}
+
+		auto signal = reader.find(argv[2]);
+		if (!signal) {
+			std::cerr << "No signal named " << argv[2] << '\n';
+			return 1;
+		}
+		std::uint64_t first = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 0;
+		std::uint64_t last  = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : std::numeric_limits<std::uint64_t>::max();
+
+		const auto width = reader.signals()[*signal].width;
+		std::cout << std::hex << std::setfill('0');
+		for (auto &[time, value]: reader.query(*signal, first, last)) {
+			std::cout << std::dec << time << '\t' << std::hex;
+			/* Most significant word first. The top word only has the digits of the width. */
+			for (std::size_t w = value.size(); w-- > 0;) {
+				const auto bits = w + 1 == value.size() ? width - w * 64 : 64;
+				std::cout << std::setw(static_cast<int>((bits + 3) / 4)) << value[w];
+			}
+			std::cout << '\n';
+		}
+	} catch (const std::exception &error) {
+		std::cerr << error.what() << '\n';
+		return 1;
+	}
+	return 0;
+}